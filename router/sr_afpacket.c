@@ -0,0 +1,468 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ *
+ * Description:
+ *
+ * AF_PACKET backend, see sr_afpacket.h.  The receive ring is walked a
+ * block at a time; every frame in a block the kernel has handed over is
+ * passed to sr_deliver_packet(..) where it lies, and the block is given
+ * back once they are all handled.  Sends fill transmit ring frames under
+ * a per-link lock and the kernel is kicked once per batch, from
+ * sr_flush_packets(..), or when the batch is full.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef _LINUX_
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#endif /* _LINUX_ */
+
+#include "sr_afpacket.h"
+#include "sr_router.h"
+#include "sr_if.h"
+
+#ifdef _LINUX_
+
+/* where a transmit frame's data starts, after its tpacket3_hdr */
+#define SR_AFP_TX_DATA  (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+/*---------------------------------------------------------------------
+ * Method: sr_ifmap_device(..)
+ * Scope:  Global
+ *
+ * Look up dev through any socket fd: its index, its MAC and, unless *ip
+ * is already set, its IPv4 address.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ifmap_device(int fd, const char* dev, int* ifindex, unsigned char* mac,
+                    uint32_t* ip)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    if ( ioctl(fd, SIOCGIFINDEX, &ifr) < 0 )
+    {
+        fprintf(stderr, "Error: no device %s\n", dev);
+        return -1;
+    }
+    *ifindex = ifr.ifr_ifindex;
+    if ( ioctl(fd, SIOCGIFHWADDR, &ifr) < 0 )
+    {
+        perror("ioctl(SIOCGIFHWADDR):sr_ifmap_device");
+        return -1;
+    }
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+    if ( *ip == 0 )
+    {
+        if ( ioctl(fd, SIOCGIFADDR, &ifr) < 0 )
+        {
+            fprintf(stderr, "Error: %s has no IPv4 address, give one with @\n",
+                    dev);
+            return -1;
+        }
+        *ip = ((struct sockaddr_in*)&(ifr.ifr_addr))->sin_addr.s_addr;
+    }
+    return 0;
+} /* -- sr_ifmap_device -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_link_open(..)
+ * Scope:  Local
+ *
+ * Open and map the rings for one device, and learn its MAC and, unless
+ * *ip is already set, its IPv4 address.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_link_open(struct sr_afp_link* l, unsigned char* mac,
+                            uint32_t* ip)
+{
+    struct tpacket_req3 rx, tx;
+    struct sockaddr_ll sll;
+    int v = TPACKET_V3, one = 1;
+
+    if ( (l->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0 )
+    {
+        perror("socket(AF_PACKET):sr_afpacket_open");
+        return -1;
+    }
+
+    if ( sr_ifmap_device(l->fd, l->dev, &(l->ifindex), mac, ip) < 0 )
+    { return -1; }
+
+    memset(&rx, 0, sizeof(rx));
+    rx.tp_block_size = SR_AFP_RX_BLOCK_SZ;
+    rx.tp_block_nr = SR_AFP_RX_BLOCKS;
+    rx.tp_frame_size = SR_AFP_FRAME_SZ;
+    rx.tp_frame_nr = SR_AFP_RX_BLOCK_SZ / SR_AFP_FRAME_SZ * SR_AFP_RX_BLOCKS;
+    rx.tp_retire_blk_tov = SR_AFP_RX_TOV;
+
+    memset(&tx, 0, sizeof(tx));
+    tx.tp_block_size = SR_AFP_TX_BLOCK_SZ;
+    tx.tp_block_nr = SR_AFP_TX_BLOCKS;
+    tx.tp_frame_size = SR_AFP_FRAME_SZ;
+    tx.tp_frame_nr = SR_AFP_TX_BLOCK_SZ / SR_AFP_FRAME_SZ * SR_AFP_TX_BLOCKS;
+
+    if ( setsockopt(l->fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0 ||
+         setsockopt(l->fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) < 0 ||
+         setsockopt(l->fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) < 0 )
+    {
+        perror("setsockopt(PACKET_*_RING):sr_afpacket_open");
+        return -1;
+    }
+    /* -- optional: frames we send skip the qdisc layer -- */
+    setsockopt(l->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    l->map_len = (size_t)SR_AFP_RX_BLOCK_SZ * SR_AFP_RX_BLOCKS +
+                 (size_t)SR_AFP_TX_BLOCK_SZ * SR_AFP_TX_BLOCKS;
+    l->map = (uint8_t*)mmap(0, l->map_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, l->fd, 0);
+    if ( l->map == MAP_FAILED )
+    {
+        l->map = 0;
+        perror("mmap(..):sr_afpacket_open");
+        return -1;
+    }
+    l->tx = l->map + (size_t)SR_AFP_RX_BLOCK_SZ * SR_AFP_RX_BLOCKS;
+    l->tx_frames = tx.tp_frame_nr;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = l->ifindex;
+    if ( bind(l->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0 )
+    {
+        perror("bind(..):sr_afpacket_open");
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_afp_link_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afpacket_open(..)
+ * Scope:  Global
+ *
+ * Bind every interface in map and add it to the router.  Returns 0 on
+ * any error, having said what it was.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_afpacket* sr_afpacket_open(struct sr_instance* sr, const char* map)
+{
+    struct sr_afpacket* afp;
+    struct sr_afp_link* l;
+    unsigned char mac[ETHER_ADDR_LEN];
+    char name[sr_IFACE_NAMELEN];
+    char dev[sr_IFACE_NAMELEN];
+    const char* p = map;
+    uint32_t ip;
+    int ret;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(map);
+
+    afp = (struct sr_afpacket*)calloc(1, sizeof(struct sr_afpacket));
+    assert(afp);
+
+    while ( (ret = sr_ifmap_parse(&p, name, dev, &ip)) > 0 )
+    {
+        if ( afp->n == SR_AFP_MAX_LINKS )
+        {
+            fprintf(stderr, "Error: at most %d interfaces\n", SR_AFP_MAX_LINKS);
+            ret = -1;
+            break;
+        }
+
+        l = &(afp->link[afp->n++]);
+        l->fd = -1;
+        strcpy(l->name, name);
+        strcpy(l->dev, dev);
+        pthread_mutex_init(&(l->tx_lock), 0);
+        if ( sr_afp_link_open(l, mac, &ip) < 0 )
+        {
+            ret = -1;
+            break;
+        }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, ip);
+    }
+
+    if ( ret < 0 || afp->n == 0 )
+    {
+        fprintf(stderr, "Error: could not set up interface map %s\n", map);
+        sr_afpacket_close(afp);
+        return 0;
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+    return afp;
+} /* -- sr_afpacket_open -- */
+
+void sr_afpacket_close(struct sr_afpacket* afp)
+{
+    unsigned int i;
+
+    if ( afp == 0 )
+    { return; }
+
+    for ( i = 0; i < afp->n; i++ )
+    {
+        if ( afp->link[i].map )
+        { munmap(afp->link[i].map, afp->link[i].map_len); }
+        if ( afp->link[i].fd >= 0 )
+        { close(afp->link[i].fd); }
+        pthread_mutex_destroy(&(afp->link[i].tx_lock));
+    }
+    free(afp);
+}
+
+/* start the kernel on the frames filled so far; caller holds tx_lock */
+static int sr_afp_kick(struct sr_afp_link* l)
+{
+    l->tx_pending = 0;
+    if ( sendto(l->fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0 &&
+         errno != EAGAIN && errno != ENOBUFS && errno != EINTR )
+    {
+        perror("sendto(..):sr_afpacket");
+        return -1;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_afpacket_send(..)
+ * Scope:  Global
+ *
+ * Copy a frame into the next free transmit frame of iface.  Returns -1
+ * and counts a drop if the ring is still full after a kick.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_afpacket_send(struct sr_afpacket* afp, uint8_t* buf, unsigned int len,
+                     const char* iface)
+{
+    struct sr_afp_link* l = 0;
+    struct tpacket3_hdr* hdr;
+    unsigned int i;
+    int ret = 0;
+
+    for ( i = 0; i < afp->n; i++ )
+    {
+        if ( strncmp(afp->link[i].name, iface, sr_IFACE_NAMELEN) == 0 )
+        {
+            l = &(afp->link[i]);
+            break;
+        }
+    }
+    if ( l == 0 )
+    {
+        fprintf(stderr, "** Error, interface %s, does not exist\n", iface);
+        return -1;
+    }
+
+    pthread_mutex_lock(&(l->tx_lock));
+
+    hdr = (struct tpacket3_hdr*)(l->tx + (size_t)l->tx_next * SR_AFP_FRAME_SZ);
+    if ( __atomic_load_n(&(hdr->tp_status), __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE &&
+         l->tx_pending > 0 )
+    { sr_afp_kick(l); }
+
+    if ( len > SR_AFP_FRAME_SZ - SR_AFP_TX_DATA ||
+         __atomic_load_n(&(hdr->tp_status), __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE )
+    {
+        l->tx_drops++;
+        ret = -1;
+    }
+    else
+    {
+        memcpy((uint8_t*)hdr + SR_AFP_TX_DATA, buf, len);
+        hdr->tp_len = len;
+        hdr->tp_snaplen = len;
+        hdr->tp_next_offset = 0;
+        __atomic_store_n(&(hdr->tp_status), TP_STATUS_SEND_REQUEST,
+                         __ATOMIC_RELEASE);
+        l->tx_next = (l->tx_next + 1) % l->tx_frames;
+        l->tx_packets++;
+        if ( ++l->tx_pending == SR_AFP_TX_BATCH )
+        { ret = sr_afp_kick(l); }
+    }
+
+    pthread_mutex_unlock(&(l->tx_lock));
+    return ret;
+} /* -- sr_afpacket_send -- */
+
+/* kick every link with frames waiting; called from sr_flush_packets(..) */
+int sr_afpacket_flush(struct sr_afpacket* afp)
+{
+    unsigned int i;
+    int ret = 0;
+
+    for ( i = 0; i < afp->n; i++ )
+    {
+        if ( __atomic_load_n(&(afp->link[i].tx_pending), __ATOMIC_RELAXED) == 0 )
+        { continue; }
+        pthread_mutex_lock(&(afp->link[i].tx_lock));
+        if ( afp->link[i].tx_pending > 0 && sr_afp_kick(&(afp->link[i])) < 0 )
+        { ret = -1; }
+        pthread_mutex_unlock(&(afp->link[i].tx_lock));
+    }
+    return ret;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_rx(..)
+ * Scope:  Local
+ *
+ * Handle every block the kernel has finished with.  Frames the router
+ * sent itself show up as PACKET_OUTGOING and are skipped.  Returns the
+ * number of frames handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_afp_rx(struct sr_instance* sr, struct sr_afp_link* l)
+{
+    struct tpacket_block_desc* bd;
+    struct tpacket3_hdr* ph;
+    struct sockaddr_ll* sll;
+    unsigned int i, npkts, handled = 0;
+
+    while ( 1 )
+    {
+        bd = (struct tpacket_block_desc*)
+             (l->map + (size_t)l->rx_block * SR_AFP_RX_BLOCK_SZ);
+        if ( (__atomic_load_n(&(bd->hdr.bh1.block_status), __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER) == 0 )
+        { break; }
+
+        npkts = bd->hdr.bh1.num_pkts;
+        ph = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for ( i = 0; i < npkts; i++ )
+        {
+            sll = (struct sockaddr_ll*)((uint8_t*)ph +
+                                        TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            if ( sll->sll_pkttype != PACKET_OUTGOING )
+            {
+                sr_deliver_packet(sr, (uint8_t*)ph + ph->tp_mac,
+                                  ph->tp_snaplen, l->name);
+                handled++;
+            }
+            ph = (struct tpacket3_hdr*)((uint8_t*)ph + ph->tp_next_offset);
+        }
+
+        __atomic_store_n(&(bd->hdr.bh1.block_status), TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        l->rx_block = (l->rx_block + 1) % SR_AFP_RX_BLOCKS;
+    }
+
+    l->rx_packets += handled;
+    return handled;
+} /* -- sr_afp_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afpacket_loop(..)
+ * Scope:  Global
+ *
+ * Main loop for this backend, in place of sr_read_from_server(..).
+ * Waits in poll(..) on every link, handles what has arrived and sends
+ * what that produced.  In event loop mode it also runs the ARP timers.
+ * Returns -1 if poll(..) fails; otherwise runs until the process ends.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_afpacket_loop(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr->afp;
+    struct pollfd pfd[SR_AFP_MAX_LINKS];
+    uint64_t now, next_tick;
+    unsigned int i, ms = sr_arpcache_tick_ms(&(sr->cache));
+    int timeout;
+
+    /* REQUIRES */
+    assert(afp);
+
+    for ( i = 0; i < afp->n; i++ )
+    {
+        pfd[i].fd = afp->link[i].fd;
+        pfd[i].events = POLLIN | POLLERR;
+    }
+    next_tick = sr_arpcache_now() + ms;
+
+    while ( 1 )
+    {
+        timeout = -1;
+        if ( sr->event_loop )
+        {
+            now = sr_arpcache_now();
+            timeout = next_tick > now ? (int)(next_tick - now) : 0;
+        }
+
+        if ( poll(pfd, afp->n, timeout) < 0 && errno != EINTR )
+        {
+            perror("poll(..):sr_afpacket_loop");
+            return -1;
+        }
+
+        /* -- a block may be ready without POLLIN if we fell behind -- */
+        for ( i = 0; i < afp->n; i++ )
+        { sr_afp_rx(sr, &(afp->link[i])); }
+        sr_flush_packets(sr);
+
+        if ( sr->event_loop && sr_arpcache_now() >= next_tick )
+        {
+            sr_arpcache_tick(sr);
+            next_tick = sr_arpcache_now() + ms;
+        }
+    }
+
+    return 0;
+} /* -- sr_afpacket_loop -- */
+
+#else
+
+struct sr_afpacket* sr_afpacket_open(struct sr_instance* sr, const char* map)
+{
+    fprintf(stderr, "Error: the AF_PACKET backend needs Linux\n");
+    return 0;
+}
+
+void sr_afpacket_close(struct sr_afpacket* afp)
+{
+}
+
+int sr_afpacket_send(struct sr_afpacket* afp, uint8_t* buf, unsigned int len,
+                     const char* iface)
+{
+    return -1;
+}
+
+int sr_afpacket_flush(struct sr_afpacket* afp)
+{
+    return 0;
+}
+
+int sr_afpacket_loop(struct sr_instance* sr)
+{
+    return -1;
+}
+
+#endif /* _LINUX_ */
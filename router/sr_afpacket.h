@@ -0,0 +1,84 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.h
+ *
+ * Description:
+ *
+ * Data-plane backend that puts the router straight onto Linux interfaces
+ * (real NICs or veth pairs) instead of the VNS tunnel.  Each router
+ * interface is bound to a host device through an AF_PACKET socket with a
+ * TPACKET_V3 receive ring of blocks and a transmit ring of frames, both
+ * mmap'd, so frames are read and written without a copy through the
+ * socket API and without a syscall per packet.
+ *
+ * The interface list comes from the host rather than VNS hwinfo: the
+ * router interface takes the device's MAC, and its IP unless one is
+ * given in the interface map.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_AFPACKET_H
+#define sr_AFPACKET_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_if.h"
+
+#define SR_AFP_MAX_LINKS    16
+#define SR_AFP_FRAME_SZ     2048
+#define SR_AFP_RX_BLOCK_SZ  (256 * 1024)
+#define SR_AFP_RX_BLOCKS    16
+#define SR_AFP_RX_TOV       1           /* ms before a partly filled block is handed over */
+#define SR_AFP_TX_BLOCK_SZ  (64 * 1024)
+#define SR_AFP_TX_BLOCKS    8
+#define SR_AFP_TX_BATCH     64          /* frames queued before the kernel is kicked */
+
+struct sr_instance;
+
+struct sr_afp_link
+{
+    char name[sr_IFACE_NAMELEN];    /* router interface */
+    char dev[sr_IFACE_NAMELEN];     /* host device */
+    int fd;
+    int ifindex;
+    uint8_t* map;                   /* rx ring, then tx ring */
+    size_t map_len;
+    unsigned int rx_block;          /* next block to look at */
+    uint8_t* tx;
+    unsigned int tx_frames;
+    unsigned int tx_next;           /* next frame to fill */
+    unsigned int tx_pending;        /* filled since the last kick */
+    pthread_mutex_t tx_lock;
+    unsigned long rx_packets;
+    unsigned long tx_packets;
+    unsigned long tx_drops;         /* ring full or frame too long */
+};
+
+struct sr_afpacket
+{
+    unsigned int n;
+    struct sr_afp_link link[SR_AFP_MAX_LINKS];
+};
+
+/* map is "name[=dev][@ip],...", e.g. "eth1=veth1,eth2=veth3@10.0.2.1";
+   dev defaults to name.  Adds the interfaces to sr. */
+struct sr_afpacket* sr_afpacket_open(struct sr_instance* , const char* map);
+void sr_afpacket_close(struct sr_afpacket* );
+int sr_afpacket_send(struct sr_afpacket* , uint8_t* buf, unsigned int len,
+                     const char* iface);
+int sr_afpacket_flush(struct sr_afpacket* );
+int sr_afpacket_loop(struct sr_instance* );
+
+/* device lookup for an interface map, shared with the AF_XDP backend */
+int sr_ifmap_device(int fd, const char* dev, int* ifindex, unsigned char* mac,
+                    uint32_t* ip);
+
+#endif  /* --  sr_AFPACKET_H -- */
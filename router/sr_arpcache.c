@@ -10,108 +10,567 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_pool.h"
+#include "sr_timer.h"
+#include "sr_rt.h"
+#include "sr_utils.h"
 
-/* 
-  This function gets called every second. For each request sent out, we keep
-  checking whether we should resend an request or destroy the arp request.
-  See the comments in the header file for an idea of what it should look like.
-*/
-void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-    /* Fill this in */
-    struct sr_arpcache *pCache = &(sr->cache);
-    struct sr_arpreq *pRequest = pCache->requests;
-    while(pRequest != NULL){
-        
-        struct sr_arpreq *temp = pRequest->next;
-        handle_arpreq(pRequest, sr);
-        pRequest = temp;
+#define ARPREQ_IDLE    0
+#define ARPREQ_RESEND  1
+#define ARPREQ_FAILED  2
+
+/* what a timer on cache->timers belongs to */
+#define ARPTIMER_ENTRY 0
+#define ARPTIMER_REQ   1
+
+/* An ARP request to send once the lock is dropped. */
+struct sr_arpcache_resend {
+    uint32_t ip;
+    struct sr_if *iface;        /* NULL: every interface */
+    int refresh;                /* ask the neighbour at mac directly */
+    unsigned char mac[ETHER_ADDR_LEN];
+};
+
+/* Sends an ARP request for ip (network byte order) on iface, or broadcasts
+   it on every interface if the request does not know where ip lives. */
+static void sr_arpcache_send_request(struct sr_instance *sr, uint32_t ip,
+                                     struct sr_if *iface) {
+    uint8_t outPacket[SR_ARP_FRAME_LEN];
+    sr_arp_hdr_t *sendArp = (sr_arp_hdr_t *)(outPacket + sizeof(sr_ethernet_hdr_t));
+    struct sr_if* ifList = iface ? iface : sr->if_list;
+
+    while(ifList != NULL){
+        memcpy(outPacket, ifList->tmpl.arp_req, SR_ARP_FRAME_LEN);
+        sendArp->ar_tip = ip;
+        sr_send_packet(sr, outPacket, sizeof(outPacket), ifList->name);
+        if(iface != NULL){
+            break;
+        }
+        ifList = ifList -> next;
     }
+}
 
+static int sr_arpcache_resend_cmp(const void *a, const void *b) {
+    unsigned long x = (unsigned long)((const struct sr_arpcache_resend *)a)->iface;
+    unsigned long y = (unsigned long)((const struct sr_arpcache_resend *)b)->iface;
+    return x < y ? -1 : x > y;
 }
 
-void handle_arpreq(struct sr_arpreq *req, struct sr_instance *sr){
-    time_t now;
-    time(&now);
-    if(difftime(now,req->sent) > 1.0){
-        if(req->times_sent >= 5){
-            struct sr_packet *pPacket = req->packets;
-            while(pPacket != NULL){
-                
-                sr_send_icmp3(sr, pPacket->buf, pPacket->len, 3, 1, pPacket->iface);
-                pPacket = pPacket->next;        
+/* The interface the route to ip goes out of, or NULL. */
+static struct sr_if *sr_arpcache_egress(struct sr_instance *sr, uint32_t ip) {
+    uint16_t nh = sr_rt_lookup(sr, ntohl(ip));
+    struct sr_nexthop *hop;
+    struct sr_if *iface;
+
+    if(nh == 0){
+        return NULL;
+    }
+    hop = &(sr->nexthops[nh]);
+    iface = __atomic_load_n(&(hop->iface), __ATOMIC_RELAXED);
+    return iface ? iface : sr_get_interface(sr, hop->interface);
+}
+
+/* Sends the requests that fell due in one tick as one batch, grouped by
+   interface so each group shares a copy of the interface's template that
+   only needs its target IP changed. Refreshes go to the neighbour rather
+   than to everyone; they are counted here, once we know whether they
+   had anywhere to go. */
+static void sr_arpcache_send_requests(struct sr_instance *sr,
+                                      struct sr_arpcache_resend *resend,
+                                      unsigned int n) {
+    uint8_t outPacket[SR_ARP_FRAME_LEN];
+    sr_arp_hdr_t *sendArp = (sr_arp_hdr_t *)(outPacket + sizeof(sr_ethernet_hdr_t));
+    sr_ethernet_hdr_t *sendEthr = (sr_ethernet_hdr_t *)outPacket;
+    struct sr_if *iface = NULL;
+    unsigned long sent = 0, dropped = 0;
+    unsigned int i;
+
+    for(i = 0; i < n; i++){
+        if(resend[i].refresh){
+            resend[i].iface = sr_arpcache_egress(sr, resend[i].ip);
+        }
+    }
+    if(n > 1){
+        qsort(resend, n, sizeof(*resend), sr_arpcache_resend_cmp);
+    }
+    for(i = 0; i < n; i++){
+        if(resend[i].iface == NULL){
+            if(!resend[i].refresh){
+                sr_arpcache_send_request(sr, resend[i].ip, NULL);
+            }
+            else{
+                dropped++;
             }
-            sr_arpreq_destroy(&(sr->cache), req);
+            continue;
+        }
+        if(resend[i].iface != iface){
+            iface = resend[i].iface;
+            memcpy(outPacket, iface->tmpl.arp_req, SR_ARP_FRAME_LEN);
+        }
+        sendArp->ar_tip = resend[i].ip;
+        if(resend[i].refresh){
+            memcpy(sendEthr->ether_dhost, resend[i].mac, ETHER_ADDR_LEN);
+            sent++;
         }
         else{
-            /* need broadcast*/
-            struct sr_if* ifList = sr->if_list;
-            while(ifList != NULL){
-                
-                uint8_t* outPacket = (uint8_t*)malloc(sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t));
-
-                /* fill arp */
-
-                sr_arp_hdr_t *sendArp = (uint8_t*)malloc(sizeof(sr_arp_hdr_t));
-                sendArp->ar_hrd = htons(0x0001);             /* format of hardware address   */
-                sendArp->ar_pro = htons(0x0800);             /* format of protocol address   */
-                sendArp->ar_hln = ETHER_ADDR_LEN;             /* length of hardware address   */
-                sendArp->ar_pln = 4;             /* length of protocol address   */
-                sendArp->ar_op = htons(0x0001);              /* ARP opcode (command)         */
-                memcpy(sendArp->ar_sha, ifList->addr, ETHER_ADDR_LEN);
-                sendArp->ar_sip = ifList->ip;
-                sendArp->ar_tip = req->ip;
-
-                /* fill ether */
-                sr_ethernet_hdr_t *sendEthr = (uint8_t*)malloc(sizeof(sr_ethernet_hdr_t));
-                memset(sendEthr->ether_dhost, 0xff, ETHER_ADDR_LEN);
-                memcpy(sendEthr->ether_shost, ifList->addr, ETHER_ADDR_LEN);
-                sendEthr->ether_type = htons(0x0806);
-
-                memcpy(outPacket, sendEthr, sizeof(sr_ethernet_hdr_t));
-                memcpy(outPacket+sizeof(sr_ethernet_hdr_t), sendArp, sizeof(sr_arp_hdr_t));
-                sr_send_packet(sr, outPacket, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), 
-                    ifList->name);
-
-                ifList = ifList -> next;
+            memset(sendEthr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+        }
+        sr_send_packet(sr, outPacket, sizeof(outPacket), iface->name);
+    }
+
+    if(sent || dropped){
+        pthread_mutex_lock(&(sr->cache.lock));
+        sr->cache.rstats.sent += sent;
+        sr->cache.rstats.dropped += dropped;
+        pthread_mutex_unlock(&(sr->cache.lock));
+    }
+}
+
+/* Sends ICMP host unreachable back for every packet waiting on req, then
+   frees it. req must already be off the request queue. */
+static void sr_arpreq_fail(struct sr_instance *sr, struct sr_arpreq *req) {
+    struct sr_packet *pPacket;
+    unsigned int i;
+    for(i = 0; i < req->count; i++){
+        pPacket = sr_arpreq_packet(req, i);
+        sr_send_icmp3(sr, pPacket->buf, pPacket->len, 3, 1, pPacket->iface);
+    }
+    pthread_mutex_lock(&(sr->cache.lock));
+    sr->cache.qstats.failed += req->count;
+    pthread_mutex_unlock(&(sr->cache.lock));
+    sr_arpreq_destroy(&(sr->cache), req);
+}
+
+/* Unlinks req from the request queue and drops its timer. Caller holds
+   the lock. */
+static void sr_arpcache_unlink(struct sr_arpcache *cache, struct sr_arpreq *entry) {
+    struct sr_arpreq **link;
+    sr_timer_cancel(cache->timers, entry->timer);
+    entry->timer = SR_TIMER_NONE;
+    for (link = &(cache->requests); *link != NULL; link = &((*link)->next)) {
+        if (*link == entry) {
+            *link = entry->next;
+            return;
+        }
+    }
+}
+
+/* Decides what is due for req and accounts for a resend. The caller does the
+   sending once it has dropped the lock. Caller holds the lock. */
+static int sr_arpreq_check(struct sr_arpcache *cache, struct sr_arpreq *req,
+                           uint64_t now) {
+    if(now >= req->due){
+        if(req->times_sent >= 5){
+            return ARPREQ_FAILED;
+        }
+        req->sent = time(NULL);
+        req->due = now + cache->retry_ms;
+        req->times_sent++;
+        if(req->timer == SR_TIMER_NONE){
+            req->timer = sr_timer_add(cache->timers, req->due, req->ip,
+                                      ARPTIMER_REQ, req);
+        }
+        else{
+            sr_timer_mod(cache->timers, req->timer, req->due);
+        }
+        return ARPREQ_RESEND;
+    }
+    return ARPREQ_IDLE;
+}
+
+/* Collected by sr_arpcache_expire while the lock is held. */
+struct sr_arpcache_due {
+    struct sr_arpcache *cache;
+    uint64_t now;
+    struct sr_arpcache_resend *resend;
+    unsigned int nResend, capResend;
+    struct sr_arpreq *failed;
+};
+
+static int sr_arpcache_find(struct sr_arptable *t, uint32_t ip);
+static void sr_arpcache_remove(struct sr_arpcache *cache, unsigned int i);
+
+/* Queues an ARP request for ip to be sent after the tick, to mac if it is
+   not NULL. */
+static void sr_arpcache_due_add(struct sr_arpcache_due *due, uint32_t ip,
+                                struct sr_if *iface, unsigned char *mac) {
+    struct sr_arpcache_resend *r;
+
+    if(due->nResend == due->capResend){
+        due->capResend = due->capResend ? 2 * due->capResend : 16;
+        due->resend = (struct sr_arpcache_resend *)realloc(due->resend,
+                          due->capResend * sizeof(*due->resend));
+    }
+    r = &(due->resend[due->nResend++]);
+    r->ip = ip;
+    r->iface = iface;
+    r->refresh = mac != NULL;
+    if(mac){
+        memcpy(r->mac, mac, ETHER_ADDR_LEN);
+    }
+}
+
+/* Moves the entry in slot i on when its timer fires. An entry that was
+   looked up since it was filled is asked for again at its refresh point,
+   and again every retry_ms until it is answered or expires; one nobody
+   used is left to expire. Caller holds the lock. */
+static void sr_arpcache_age(struct sr_arpcache_due *due, unsigned int i) {
+    struct sr_arpcache *pCache = due->cache;
+    struct sr_arpentry *pEntry = &(pCache->table->entries[i]);
+    uint64_t next;
+    int used;
+
+    pEntry->timer = SR_TIMER_NONE;
+    if(due->now >= pEntry->expires){
+        if(pEntry->state == sr_arpentry_refreshing){
+            pCache->rstats.failed++;
+        }
+        sr_arpcache_remove(pCache, i);
+        return;
+    }
+
+    if(pEntry->state == sr_arpentry_refreshed){
+        /* the lifetime it had before the answer is over */
+        __atomic_store_n(&(pEntry->used), 0, __ATOMIC_RELAXED);
+        pEntry->state = sr_arpentry_watched;
+        next = pEntry->refresh_at;
+    }
+    else{
+        if(pEntry->state != sr_arpentry_refreshing){
+            used = __atomic_load_n(&(pEntry->used), __ATOMIC_RELAXED);
+            if(pEntry->state == sr_arpentry_watched && used){
+                pCache->rstats.avoided++;
             }
-                                  
-            req->sent = now;
-            req->times_sent++;
+            pEntry->state = used ? sr_arpentry_refreshing : sr_arpentry_fresh;
+        }
+        if(pEntry->state == sr_arpentry_refreshing){
+            sr_arpcache_due_add(due, pEntry->ip, NULL, pEntry->mac);
+            next = due->now + pCache->retry_ms;
+        }
+        else{
+            next = pEntry->expires;
+        }
+    }
+    if(next > pEntry->expires){
+        next = pEntry->expires;
+    }
+    pEntry->timer = sr_timer_add(pCache->timers, next, pEntry->ip,
+                                 ARPTIMER_ENTRY, NULL);
+}
+
+/* Called by the timer wheel for each entry or request that is due. */
+static void sr_arpcache_expire(void *arg, int id, uint32_t ip, int kind,
+                               void *ptr) {
+    struct sr_arpcache_due *due = arg;
+    struct sr_arpcache *pCache = due->cache;
+    struct sr_arpreq *pRequest = ptr;
+    int i;
 
+    if(kind == ARPTIMER_ENTRY){
+        i = sr_arpcache_find(pCache->table, ip);
+        if(i >= 0 && pCache->table->entries[i].timer == id){
+            sr_arpcache_age(due, i);
         }
+        return;
+    }
+
+    pRequest->timer = SR_TIMER_NONE;
+    switch(sr_arpreq_check(pCache, pRequest, due->now)){
+        case ARPREQ_FAILED:
+            sr_arpcache_unlink(pCache, pRequest);
+            pRequest->next = due->failed;
+            due->failed = pRequest;
+            break;
+        case ARPREQ_RESEND:
+            sr_arpcache_due_add(due, pRequest->ip, pRequest->iface, NULL);
+            break;
+        default:
+            pRequest->timer = sr_timer_add(pCache->timers, pRequest->due,
+                                           pRequest->ip, ARPTIMER_REQ, pRequest);
+            break;
+    }
+}
+
+/* 
+  This function gets called every tick. For each request sent out, we keep
+  checking whether we should resend an request or destroy the arp request.
+  See the comments in the header file for an idea of what it should look like.
+
+  Rather than walking the whole queue, the timer wheel hands us the requests
+  that are due, and the cache entries that have timed out along with them.
+  That happens under the lock; ARP requests and ICMP errors are sent after
+  it is released so forwarding threads are not held up by them.
+*/
+void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
+    struct sr_arpcache_due due;
+    struct sr_arpreq *pNext;
+
+    memset(&due, 0, sizeof(due));
+    due.cache = &(sr->cache);
+    due.now = sr_arpcache_now();
+
+    pthread_mutex_lock(&(due.cache->lock));
+    sr_timer_run(due.cache->timers, due.now, sr_arpcache_expire, &due);
+    pthread_mutex_unlock(&(due.cache->lock));
+
+    sr_arpcache_send_requests(sr, due.resend, due.nResend);
+    free(due.resend);
+
+    while(due.failed != NULL){
+        pNext = due.failed->next;
+        sr_arpreq_fail(sr, due.failed);
+        due.failed = pNext;
     }
+
+    sr_flush_packets(sr);
 }
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+#define SR_ARPCACHE_HASH(t, ip) (((uint32_t)(ip) * 2654435761U) >> (t)->shift)
+#define SR_ARPCACHE_NEXT(t, i) (((i) + 1) & ((t)->capacity - 1))
+
+/* Readers never take the lock. Writers, serialized by the lock, make seq odd
+   while they change the table; a reader that saw an odd or changed seq
+   retries. Tables replaced by a resize are kept on the retired list until
+   the cache is destroyed, so a reader still probing one is safe. Doubling
+   bounds the retired memory by the size of the live table. */
+
+static void sr_arpcache_write_begin(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void sr_arpcache_write_end(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int sr_arpcache_read_begin(struct sr_arpcache *cache) {
+    unsigned int seq;
+    while ((seq = __atomic_load_n(&(cache->seq), __ATOMIC_ACQUIRE)) & 1)
+        sched_yield();
+    return seq;
+}
+
+static int sr_arpcache_read_retry(struct sr_arpcache *cache, unsigned int seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&(cache->seq), __ATOMIC_RELAXED) != seq;
+}
+
+/* Returns the slot holding ip, or -1. Caller holds the lock. */
+static int sr_arpcache_find(struct sr_arptable *t, uint32_t ip) {
+    unsigned int i;
     
-    struct sr_arpentry *entry = NULL, *copy = NULL;
+    for (i = SR_ARPCACHE_HASH(t, ip); t->entries[i].valid;
+         i = SR_ARPCACHE_NEXT(t, i)) {
+        if (t->entries[i].ip == ip)
+            return i;
+    }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+    return -1;
+}
+
+/* Empties slot i, moving later entries of the probe run back so lookups
+   never need tombstones. Caller holds the lock. */
+static void sr_arpcache_remove(struct sr_arpcache *cache, unsigned int i) {
+    struct sr_arptable *t = cache->table;
+    unsigned int j = i, home;
+    
+    sr_timer_cancel(cache->timers, t->entries[i].timer);
+    sr_arpcache_write_begin(cache);
+    while (1) {
+        j = SR_ARPCACHE_NEXT(t, j);
+        if (!t->entries[j].valid)
+            break;
+        
+        /* The entry at j may fill the hole unless its home slot lies
+           cyclically in (i, j]. */
+        home = SR_ARPCACHE_HASH(t, t->entries[j].ip);
+        if ((i < j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            t->entries[i] = t->entries[j];
+            i = j;
         }
     }
     
+    t->entries[i].valid = 0;
+    sr_arpcache_write_end(cache);
+    cache->count--;
+}
+
+/* Allocates an empty table of at least the given number of slots. */
+static struct sr_arptable *sr_arpcache_alloc(unsigned int capacity) {
+    struct sr_arptable *t;
+    unsigned int bits = 0;
+    
+    while ((1U << bits) < capacity)
+        bits++;
+    
+    t = (struct sr_arptable *) calloc(1, sizeof(struct sr_arptable) +
+            (1U << bits) * sizeof(struct sr_arpentry));
+    if (!t)
+        return NULL;
+    
+    t->capacity = 1U << bits;
+    t->shift = 32 - bits;
+    t->entries = (struct sr_arpentry *)(t + 1);
+    return t;
+}
+
+/* Builds a table twice the size off to the side and swaps it in.
+   Caller holds the lock. */
+static int sr_arpcache_grow(struct sr_arpcache *cache) {
+    struct sr_arptable *old = cache->table, *t;
+    unsigned int i, j;
+    
+    if ((t = sr_arpcache_alloc(2 * old->capacity)) == NULL)
+        return -1;
+    
+    for (i = 0; i < old->capacity; i++) {
+        if (!old->entries[i].valid)
+            continue;
+        for (j = SR_ARPCACHE_HASH(t, old->entries[i].ip); t->entries[j].valid;
+             j = SR_ARPCACHE_NEXT(t, j))
+            ;
+        t->entries[j] = old->entries[i];
+    }
+    
+    t->retired = old;
+    sr_arpcache_write_begin(cache);
+    __atomic_store_n(&(cache->table), t, __ATOMIC_RELEASE);
+    sr_arpcache_write_end(cache);
+    cache->hand = 0;
+    return 0;
+}
+
+/* Second-chance CLOCK: skip and clear recently used entries, evict the
+   first one that has not been used since the hand last came round.
+   Caller holds the lock. */
+static void sr_arpcache_evict(struct sr_arpcache *cache) {
+    struct sr_arptable *t = cache->table;
+    struct sr_arpentry *entry;
+    
+    while (1) {
+        entry = &(t->entries[cache->hand]);
+        if (entry->valid) {
+            if (!__atomic_load_n(&(entry->referenced), __ATOMIC_RELAXED)) {
+                sr_arpcache_remove(cache, cache->hand);
+                return;
+            }
+            __atomic_store_n(&(entry->referenced), 0, __ATOMIC_RELAXED);
+        }
+        cache->hand = SR_ARPCACHE_NEXT(t, cache->hand);
+    }
+}
+
+/* Copies the entry for ip into *out without taking the lock. Returns 1 on a
+   hit, 0 on a miss. */
+static int sr_arpcache_read(struct sr_arpcache *cache, uint32_t ip,
+                            struct sr_arpentry *out) {
+    struct sr_arptable *t;
+    struct sr_arpentry *entry;
+    unsigned int seq, i, n;
+    
+    do {
+        seq = sr_arpcache_read_begin(cache);
+        t = __atomic_load_n(&(cache->table), __ATOMIC_ACQUIRE);
+        entry = NULL;
+        /* bounded: a torn read must not send us round the table forever */
+        for (i = SR_ARPCACHE_HASH(t, ip), n = 0;
+             n < t->capacity && t->entries[i].valid;
+             i = SR_ARPCACHE_NEXT(t, i), n++) {
+            if (t->entries[i].ip == ip) {
+                entry = &(t->entries[i]);
+                *out = *entry;
+                break;
+            }
+        }
+    } while (sr_arpcache_read_retry(cache, seq));
+    
+    if (!entry)
+        return 0;
+    
+    /* Only hints for CLOCK and refresh; landing on a slot that just moved
+       is harmless. */
+    if (!out->referenced)
+        __atomic_store_n(&(entry->referenced), 1, __ATOMIC_RELAXED);
+    if (!out->used)
+        __atomic_store_n(&(entry->used), 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   You must free the returned structure if it is not NULL. */
+struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
+    struct sr_arpentry entry, *copy = NULL;
+    
     /* Must return a copy b/c another thread could jump in and modify
        table after we return. */
-    if (entry) {
+    if (sr_arpcache_read(cache, ip, &entry)) {
         copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
+        memcpy(copy, &entry, sizeof(struct sr_arpentry));
     }
-        
-    pthread_mutex_unlock(&(cache->lock));
     
     return copy;
 }
 
+/* Same as sr_arpcache_lookup, but copies the entry into *entry instead of
+   allocating. Returns 1 on a hit and, if age is not NULL, sets it to the
+   seconds since the entry was added. Returns 0 on a miss. */
+int sr_arpcache_lookup_copy(struct sr_arpcache *cache, uint32_t ip,
+                            struct sr_arpentry *entry, time_t *age) {
+    if (!sr_arpcache_read(cache, ip, entry))
+        return 0;
+    
+    if (age)
+        *age = time(NULL) - entry->added;
+    return 1;
+}
+
+/* Drops the oldest packet waiting on req. Caller holds the lock. */
+static void sr_arpreq_pop(struct sr_arpcache *cache, struct sr_arpreq *req) {
+    struct sr_packet *pkt = req->packets[req->head];
+    cache->queue_bytes -= sizeof(struct sr_packet) + pkt->len;
+    sr_pool_put(cache->pool, pkt);
+    req->head = (req->head + 1) % req->depth;
+    req->count--;
+}
+
+/* Queues a copy of packet on req unless the queue or the memory cap says
+   otherwise. Under drop-oldest only req's own packets make way: a request
+   never pushes out another's. Caller holds the lock. */
+static void sr_arpreq_push(struct sr_arpcache *cache, struct sr_arpreq *req,
+                           uint8_t *packet, unsigned int packet_len,
+                           char *iface) {
+    unsigned long need = sizeof(struct sr_packet) + packet_len;
+    struct sr_packet *pkt;
+
+    if (cache->queue_policy == sr_arpq_drop_oldest) {
+        while (req->count > 0 && (req->count == req->depth ||
+               cache->queue_bytes + need > cache->queue_max_bytes)) {
+            sr_arpreq_pop(cache, req);
+            cache->qstats.dropped++;
+        }
+    }
+    if (req->count == req->depth ||
+        cache->queue_bytes + need > cache->queue_max_bytes) {
+        cache->qstats.dropped++;
+        return;
+    }
+
+    pkt = (struct sr_packet *)sr_pool_get(cache->pool, need);
+    pkt->buf = (uint8_t *)(pkt + 1);
+    memcpy(pkt->buf, packet, packet_len);
+    pkt->len = packet_len;
+    strncpy(pkt->iface, iface, sr_IFACE_NAMELEN);
+
+    req->packets[(req->head + req->count) % req->depth] = pkt;
+    req->count++;
+    cache->queue_bytes += need;
+    cache->qstats.queued++;
+}
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
-   the queue, adds the packet to the linked list of packets for this sr_arpreq
+   the queue, adds the packet to the queue of packets for this sr_arpreq
    that corresponds to this ARP request. You should free the passed *packet.
    
    A pointer to the ARP request is returned; it should not be freed. The caller
@@ -120,7 +579,8 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       char *iface,
+                                       struct sr_if *egress)
 {
     pthread_mutex_lock(&(cache->lock));
     
@@ -131,26 +591,41 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         }
     }
     
-    /* If the IP wasn't found, add it */
+    /* Answered since the caller looked: its packets must not wait behind
+       a new request while later ones of the same flow find the entry. */
+    if (!req && packet && sr_arpcache_find(cache->table, ip) >= 0) {
+        pthread_mutex_unlock(&(cache->lock));
+        return NULL;
+    }
+    
+    /* If the IP wasn't found, add it; counted with the packet path's
+       other allocations, as it is made for a packet */
     if (!req) {
-        req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
+        size_t size = sizeof(struct sr_arpreq) +
+                      cache->queue_depth * sizeof(struct sr_packet *);
+        req = (struct sr_arpreq *) sr_pkt_malloc(size);
+        if (req == NULL) {
+            if (packet)
+                cache->qstats.dropped++;
+            pthread_mutex_unlock(&(cache->lock));
+            return NULL;
+        }
+        memset(req, 0, size);
         req->ip = ip;
+        req->packets = (struct sr_packet **)(req + 1);
+        req->depth = cache->queue_depth;
+        /* never sent, so due straight away */
+        req->timer = sr_timer_add(cache->timers, 0, ip, ARPTIMER_REQ, req);
         req->next = cache->requests;
         cache->requests = req;
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
-        
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
-        new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = req->packets;
-        req->packets = new_pkt;
-    }
+    if (egress)
+        req->iface = egress;
+    
+    /* Add the packet to the queue of packets for this request */
+    if (packet && packet_len && iface)
+        sr_arpreq_push(cache, req, packet, packet_len, iface);
     
     pthread_mutex_unlock(&(cache->lock));
     
@@ -164,42 +639,95 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
                                      uint32_t ip)
+{
+    struct sr_arpreq *req = sr_arpcache_insert_begin(cache, ip);
+    sr_arpcache_insert_end(cache, mac, ip);
+    return req;
+}
+
+/* The first half of sr_arpcache_insert: takes the lock and the request for
+   ip off the queue, and leaves the cache locked. */
+struct sr_arpreq *sr_arpcache_insert_begin(struct sr_arpcache *cache,
+                                           uint32_t ip)
 {
     pthread_mutex_lock(&(cache->lock));
     
-    struct sr_arpreq *req, *prev = NULL, *next = NULL; 
+    struct sr_arpreq *req; 
     for (req = cache->requests; req != NULL; req = req->next) {
         if (req->ip == ip) {            
-            if (prev) {
-                next = req->next;
-                prev->next = next;
-            } 
-            else {
-                next = req->next;
-                cache->requests = next;
-            }
-            
+            sr_arpcache_unlink(cache, req);
+            cache->qstats.drained += req->count;  /* the caller sends them */
             break;
         }
-        prev = req;
     }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
+    return req;
+}
+
+/* Between the two halves: n of the request's packets could not be sent after
+   all, so they count as dropped rather than drained. */
+void sr_arpcache_unsent(struct sr_arpcache *cache, unsigned int n)
+{
+    cache->qstats.drained -= n;
+    cache->qstats.dropped += n;
+}
+
+/* The second half: the entry becomes visible and the lock is released. */
+void sr_arpcache_insert_end(struct sr_arpcache *cache, unsigned char *mac,
+                            uint32_t ip)
+{
+    uint64_t now = sr_arpcache_now();
+    int i = sr_arpcache_find(cache->table, ip);
+    
+    if (i < 0) {
+        if (cache->count >= cache->max_entries)
+            sr_arpcache_evict(cache);
+        else if (2 * (cache->count + 1) > cache->table->capacity &&
+                 sr_arpcache_grow(cache) != 0 &&
+                 cache->count + 1 >= cache->table->capacity)
+            sr_arpcache_evict(cache);   /* could not grow, make room */
+        
+        for (i = SR_ARPCACHE_HASH(cache->table, ip); cache->table->entries[i].valid;
+             i = SR_ARPCACHE_NEXT(cache->table, i))
+            ;
+        cache->count++;
+        cache->table->entries[i].state = sr_arpentry_fresh;
+        cache->table->entries[i].timer = SR_TIMER_NONE;
     }
     
-    if (i != SR_ARPCACHE_SZ) {
-        memcpy(cache->entries[i].mac, mac, 6);
-        cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
-        cache->entries[i].valid = 1;
+    struct sr_arpentry *entry = &(cache->table->entries[i]);
+    uint64_t refresh_at = now + (uint64_t)cache->timeout_ms *
+                          SR_ARPCACHE_REFRESH / 100;
+    uint64_t next = refresh_at;
+    
+    /* An answer to a refresh: keep watching until the old lifetime is up,
+       to tell whether the entry would have been missed. */
+    if (entry->valid && entry->state == sr_arpentry_refreshing) {
+        cache->rstats.answered++;
+        entry->state = sr_arpentry_refreshed;
+        next = entry->expires;
     }
+    else
+        entry->state = sr_arpentry_fresh;
     
-    pthread_mutex_unlock(&(cache->lock));
+    if (entry->timer == SR_TIMER_NONE)
+        entry->timer = sr_timer_add(cache->timers, next, ip, ARPTIMER_ENTRY,
+                                    NULL);
+    else
+        sr_timer_mod(cache->timers, entry->timer, next);
     
-    return req;
+    sr_arpcache_write_begin(cache);
+    memcpy(entry->mac, mac, 6);
+    entry->ip = ip;
+    entry->added = time(NULL);
+    entry->expires = now + cache->timeout_ms;
+    entry->refresh_at = refresh_at;
+    entry->referenced = 1;
+    entry->used = 0;
+    entry->valid = 1;
+    sr_arpcache_write_end(cache);
+    
+    pthread_mutex_unlock(&(cache->lock));
 }
 
 /* Frees all memory associated with this arp request entry. If this arp request
@@ -208,33 +736,10 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
     pthread_mutex_lock(&(cache->lock));
     
     if (entry) {
-        struct sr_arpreq *req, *prev = NULL, *next = NULL; 
-        for (req = cache->requests; req != NULL; req = req->next) {
-            if (req == entry) {                
-                if (prev) {
-                    next = req->next;
-                    prev->next = next;
-                } 
-                else {
-                    next = req->next;
-                    cache->requests = next;
-                }
-                
-                break;
-            }
-            prev = req;
-        }
+        sr_arpcache_unlink(cache, entry);
         
-        struct sr_packet *pkt, *nxt;
-        
-        for (pkt = entry->packets; pkt; pkt = nxt) {
-            nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
-        }
+        while (entry->count > 0)
+            sr_arpreq_pop(cache, entry);
         
         free(entry);
     }
@@ -247,24 +752,70 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
     fprintf(stderr, "-----------------------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        struct sr_arpentry *cur = &(cache->entries[i]);
+    pthread_mutex_lock(&(cache->lock));
+    
+    unsigned int i;
+    for (i = 0; i < cache->table->capacity; i++) {
+        struct sr_arpentry *cur = &(cache->table->entries[i]);
+        if (!cur->valid)
+            continue;
         unsigned char *mac = cur->mac;
         fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
     }
     
+    fprintf(stderr, "%u of %u entries, %u slots\n", cache->count,
+            cache->max_entries, cache->table->capacity);
+    fprintf(stderr, "pending packets: %lu queued, %lu drained, %lu dropped, "
+            "%lu failed, %lu bytes held\n", cache->qstats.queued,
+            cache->qstats.drained, cache->qstats.dropped,
+            cache->qstats.failed, cache->queue_bytes);
+    fprintf(stderr, "refreshes: %lu sent, %lu dropped, %lu answered, "
+            "%lu failed, %lu stalls avoided\n", cache->rstats.sent,
+            cache->rstats.dropped, cache->rstats.answered,
+            cache->rstats.failed, cache->rstats.avoided);
+    
+    pthread_mutex_unlock(&(cache->lock));
+    
     fprintf(stderr, "\n");
 }
 
+/* Limits the cache to max_entries neighbours, evicting if it already holds
+   more. Returns 0 on success. */
+int sr_arpcache_set_max(struct sr_arpcache *cache, unsigned int max_entries) {
+    if (max_entries == 0)
+        return -1;
+    
+    pthread_mutex_lock(&(cache->lock));
+    
+    cache->max_entries = max_entries;
+    while (cache->count > cache->max_entries)
+        sr_arpcache_evict(cache);
+    
+    pthread_mutex_unlock(&(cache->lock));
+    
+    return 0;
+}
+
 /* Initialize table + table lock. Returns 0 on success. */
 int sr_arpcache_init(struct sr_arpcache *cache) {  
-    /* Seed RNG to kick out a random entry if all entries full. */
-    srand(time(NULL));
-    
-    /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
+    /* Start with room for SR_ARPCACHE_SZ entries at half load. */
+    if ((cache->table = sr_arpcache_alloc(2 * SR_ARPCACHE_SZ)) == NULL)
+        return -1;
+    cache->count = 0;
+    cache->hand = 0;
+    cache->seq = 0;
+    cache->max_entries = SR_ARPCACHE_MAX;
+    cache->retry_ms = SR_ARPREQ_RETRY_MS;
+    cache->timeout_ms = (unsigned int)(SR_ARPCACHE_TO * 1000);
     cache->requests = NULL;
+    cache->pool = NULL;
+    cache->queue_depth = SR_ARPREQ_QLEN;
+    cache->queue_policy = sr_arpq_drop_oldest;
+    cache->queue_max_bytes = SR_ARPQ_MAX_BYTES;
+    cache->queue_bytes = 0;
+    memset(&(cache->qstats), 0, sizeof(cache->qstats));
+    memset(&(cache->rstats), 0, sizeof(cache->rstats));
+    cache->timers = sr_timer_create(sr_arpcache_now());
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
@@ -276,34 +827,97 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    struct sr_arptable *t, *next;
+    for (t = cache->table; t != NULL; t = next) {
+        next = t->retired;
+        free(t);
+    }
+    cache->table = NULL;
+    cache->count = 0;
+    sr_timer_destroy(cache->timers);
+    cache->timers = NULL;
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+int sr_arpcache_set_timers(struct sr_arpcache *cache, unsigned int retry_ms,
+                           unsigned int timeout_ms) {
+    pthread_mutex_lock(&(cache->lock));
+    if (retry_ms)
+        cache->retry_ms = retry_ms;
+    if (timeout_ms)
+        cache->timeout_ms = timeout_ms;
+    pthread_mutex_unlock(&(cache->lock));
+    return 0;
+}
+
+int sr_arpcache_set_queue(struct sr_arpcache *cache, unsigned int depth,
+                          int policy, unsigned long max_bytes) {
+    if (policy > sr_arpq_drop_newest || depth > SR_ARPREQ_QMAX)
+        return -1;
+    pthread_mutex_lock(&(cache->lock));
+    if (depth)
+        cache->queue_depth = depth;
+    if (policy >= 0)
+        cache->queue_policy = policy;
+    if (max_bytes)
+        cache->queue_max_bytes = max_bytes;
+    pthread_mutex_unlock(&(cache->lock));
+    return 0;
+}
+
+void sr_arpcache_queue_stats(struct sr_arpcache *cache,
+                             struct sr_arpq_stats *stats) {
+    pthread_mutex_lock(&(cache->lock));
+    *stats = cache->qstats;
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+void sr_arpcache_refresh_stats(struct sr_arpcache *cache,
+                               struct sr_arprefresh_stats *stats) {
+    pthread_mutex_lock(&(cache->lock));
+    *stats = cache->rstats;
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+uint64_t sr_arpcache_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* A quarter of the shortest timer, so nothing runs more than a quarter
+   late, but no more than once a millisecond or less than once a second. */
+unsigned int sr_arpcache_tick_ms(struct sr_arpcache *cache) {
+    unsigned int ms = cache->retry_ms < cache->timeout_ms ?
+                      cache->retry_ms : cache->timeout_ms;
+    ms /= 4;
+    if (ms < 1)
+        ms = 1;
+    if (ms > 1000)
+        ms = 1000;
+    return ms;
+}
+
+/* Entries time out on the same wheel as requests, so the sweep does both. */
+void sr_arpcache_tick(struct sr_instance *sr) {
+    sr_arpcache_sweepreqs(sr);
+}
+
+/* Thread which times out cache entries and handles pending requests, see
+   sr_arpcache_tick. Not started when the router runs its event loop. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
-    struct sr_arpcache *cache = &(sr->cache);
+    struct timespec ts;
+    unsigned int ms;
     
     while (1) {
-        sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
-        }
+        ms = sr_arpcache_tick_ms(&(sr->cache));
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000L;
+        nanosleep(&ts, NULL);
         
-        sr_arpcache_sweepreqs(sr);
-
-        pthread_mutex_unlock(&(cache->lock));
+        sr_arpcache_tick(sr);
     }
     
     return NULL;
 }
-
@@ -71,21 +71,51 @@
 #include <pthread.h>
 #include "sr_if.h"
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    100       /* entries the table starts out sized for */
+#define SR_ARPCACHE_MAX   131072    /* default limit before entries are evicted */
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_REFRESH 80      /* percent of the lifetime at which a
+                                       neighbour in use is asked again */
+#define SR_ARPREQ_RETRY_MS 1000     /* default time between ARP request retries */
+#define SR_ARPREQ_QLEN    32        /* default packets queued per request */
+#define SR_ARPREQ_QMAX    4096      /* most packets a request may queue */
+#define SR_ARPQ_MAX_BYTES (4 << 20) /* default cap on all queued packets */
+
+enum sr_arpq_policy {
+    sr_arpq_drop_oldest = 0,    /* a full queue makes room for the newcomer */
+    sr_arpq_drop_newest         /* a full queue turns the newcomer away */
+};
+
+struct sr_pool;
+struct sr_timers;
 
+/* Allocated as one pool buffer, with the frame right behind the struct. */
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
-    struct sr_packet *next;
+    char iface[sr_IFACE_NAMELEN];   /* The interface it arrived on */
+};
+
+/* Where an entry is in its life. Forwarding uses it in every state. */
+enum sr_arpentry_state {
+    sr_arpentry_fresh = 0,      /* waiting for its refresh point */
+    sr_arpentry_refreshing,     /* asked again, not answered yet */
+    sr_arpentry_refreshed,      /* answered, the old lifetime still running */
+    sr_arpentry_watched         /* past the old lifetime, a lookup now is a
+                                   stall the refresh avoided */
 };
 
 struct sr_arpentry {
     unsigned char mac[6]; 
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
+    uint64_t expires;           /* sr_arpcache_now() at which it times out */
+    uint64_t refresh_at;        /* sr_arpcache_now() at which to ask again */
     int valid;
+    int referenced;             /* used since the CLOCK hand last passed */
+    int used;                   /* looked up since the last state change */
+    int state;                  /* enum sr_arpentry_state */
+    int timer;                  /* its next state change on cache->timers */
 };
 
 struct sr_arpreq {
@@ -95,35 +125,107 @@ struct sr_arpreq {
                                    never sent, will be 0. */
     uint32_t times_sent;        /* Number of times this request was sent. You 
                                    should update this. */
-    struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    uint64_t due;               /* sr_arpcache_now() at which to resend, 0 if
+                                   it never has been sent */
+    int timer;                  /* its next retry on cache->timers */
+    struct sr_if *iface;        /* where ip lives, so where to ask for it;
+                                   NULL asks on every interface */
+    struct sr_packet **packets; /* Ring of pkts waiting on this req to finish,
+                                   depth slots right behind the struct */
+    unsigned int head;          /* oldest packet */
+    unsigned int count;
+    unsigned int depth;
     struct sr_arpreq *next;
 };
 
+/* The i-th oldest packet waiting on req, for i < req->count. */
+#define sr_arpreq_packet(req, i) \
+    ((req)->packets[((req)->head + (i)) % (req)->depth])
+
+/* What happened to packets that had to wait for ARP. */
+struct sr_arpq_stats {
+    unsigned long queued;
+    unsigned long drained;      /* sent once the neighbour answered */
+    unsigned long dropped;      /* turned away or pushed out by a full queue */
+    unsigned long failed;       /* answered with host unreachable */
+};
+
+/* What came of asking neighbours in use again before they expire. */
+struct sr_arprefresh_stats {
+    unsigned long sent;         /* unicast requests, retries included */
+    unsigned long dropped;      /* not sent, no route to the neighbour */
+    unsigned long answered;
+    unsigned long failed;       /* expired without an answer */
+    unsigned long avoided;      /* looked up after the lifetime they would
+                                   have had, so not stalled in the queue */
+};
+
+/* The entries form an open addressing hash table keyed by IP with linear
+   probing.  It doubles in size as it fills, up to max_entries neighbours;
+   after that inserting a new neighbour evicts one picked by a CLOCK sweep. */
+struct sr_arptable {
+    unsigned int capacity;      /* slots, a power of two */
+    unsigned int shift;         /* 32 - log2(capacity), for hashing */
+    struct sr_arptable *retired;    /* tables this one replaced */
+    struct sr_arpentry *entries;
+};
+
+/* Lookups read the table under a sequence lock and never block; everything
+   that modifies the cache or the request queue takes the mutex. Entry
+   expiries and request retries sit on a timer wheel, so a tick only visits
+   what is due. */
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arptable *table;
+    unsigned int seq;           /* odd while the table is being changed */
+    unsigned int count;         /* valid entries */
+    unsigned int max_entries;
+    unsigned int hand;          /* CLOCK hand */
+    unsigned int retry_ms;      /* between ARP requests for the same IP */
+    unsigned int timeout_ms;    /* lifetime of an entry */
+    struct sr_timers *timers;   /* entries by IP, requests by pointer */
     struct sr_arpreq *requests;
+    struct sr_pool *pool;       /* queued packets are kept here, may be NULL */
+    unsigned int queue_depth;   /* packets per request */
+    int queue_policy;           /* enum sr_arpq_policy */
+    unsigned long queue_max_bytes;  /* over all requests */
+    unsigned long queue_bytes;
+    struct sr_arpq_stats qstats;
+    struct sr_arprefresh_stats rstats;
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
 };
 
 
-void handle_arpreq(struct sr_arpreq *req, struct sr_instance *sr);
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
 
+/* Same as sr_arpcache_lookup, but copies the entry into *entry instead of
+   allocating. Returns 1 on a hit and, if age is not NULL, sets it to the
+   seconds since the entry was added. Returns 0 on a miss. */
+int sr_arpcache_lookup_copy(struct sr_arpcache *cache, uint32_t ip,
+                            struct sr_arpentry *entry, time_t *age);
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
-   the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. The packet argument should not be
-   freed by the caller.
+   the queue, adds a copy of the packet to the queue of packets for this
+   sr_arpreq, subject to the queue depth, policy and memory cap. The packet
+   argument should not be freed by the caller.
+
+   egress is the interface the route to ip goes out of, and the only one the
+   ARP request is sent on; NULL keeps what the request already has.
 
    A pointer to the ARP request is returned; it should be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   If ip was answered after the caller looked it up, nothing is queued and
+   NULL is returned; the caller should look again. NULL is also returned,
+   with the packet counted as dropped, if there is no memory for a new
+   request. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         char *iface,
+                         struct sr_if *egress);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
@@ -133,6 +235,18 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
                                      uint32_t ip);
 
+/* sr_arpcache_insert in two halves, for a caller that must dispose of the
+   queued packets before any other thread can find the entry: _begin takes
+   the request off the queue and returns with the cache locked, _end makes
+   the entry visible and unlocks. */
+struct sr_arpreq *sr_arpcache_insert_begin(struct sr_arpcache *cache,
+                                           uint32_t ip);
+void sr_arpcache_insert_end(struct sr_arpcache *cache, unsigned char *mac,
+                            uint32_t ip);
+/* Called between the halves for queued packets the caller could not send:
+   they are counted as dropped instead of drained. */
+void sr_arpcache_unsent(struct sr_arpcache *cache, unsigned int n);
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
@@ -140,10 +254,44 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Limits the cache to max_entries neighbours. Returns 0 on success. */
+int sr_arpcache_set_max(struct sr_arpcache *cache, unsigned int max_entries);
+
+/* Sets the ARP request retry interval and the entry lifetime, both in
+   milliseconds; 0 leaves a value as it is. Returns 0 on success. */
+int sr_arpcache_set_timers(struct sr_arpcache *cache, unsigned int retry_ms,
+                           unsigned int timeout_ms);
+
+/* Sets the packets queued per request, what a full queue does (enum
+   sr_arpq_policy) and the cap on bytes queued over all requests; 0 or -1
+   for the policy leaves a value as it is. The depth applies to new
+   requests. Returns 0 on success, -1 for a depth above SR_ARPREQ_QMAX or
+   an unknown policy. */
+int sr_arpcache_set_queue(struct sr_arpcache *cache, unsigned int depth,
+                          int policy, unsigned long max_bytes);
+
+/* Copies the pending packet counters into *stats. */
+void sr_arpcache_queue_stats(struct sr_arpcache *cache,
+                             struct sr_arpq_stats *stats);
+
+/* Copies the refresh counters into *stats. */
+void sr_arpcache_refresh_stats(struct sr_arpcache *cache,
+                               struct sr_arprefresh_stats *stats);
+
+/* Milliseconds on a monotonic clock; the timestamps above use it. */
+uint64_t sr_arpcache_now(void);
+
+/* How often sr_arpcache_tick should run to honour the timers, in ms. */
+unsigned int sr_arpcache_tick_ms(struct sr_arpcache *cache);
+
+/* Times out cache entries and retries or fails pending requests. Called
+   by the cleanup thread, or by the event loop when there is no thread. */
+void sr_arpcache_tick(struct sr_instance *sr);
+
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
-   a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   a destructor, and a cleanup thread calls sr_arpcache_tick every
+   sr_arpcache_tick_ms. */
 
 int   sr_arpcache_init(struct sr_arpcache *cache);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
@@ -0,0 +1,725 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Offline driver for timing sr_handlepacket(..) without VNS or a
+ * topology.  It loads a routing table and an interface file, reads frames
+ * from a pcap file (as written by sr_dumper.c) and replays them into the
+ * router in a loop.  sr_tx_submit(..) is replaced by a stub that only
+ * counts, so what is timed is the router itself: parsing, lookup, ARP
+ * cache, rewrite and checksums.
+ *
+ * With -W the timed passes go through that many worker threads and the
+ * writer (see sr_workers.h) instead, and the time includes draining them.
+ *
+ * The interface file has one "name ip mac" line per interface, e.g.
+ *
+ *     eth1 10.0.1.1 02:00:00:00:00:01
+ *
+ * Each frame is handed to the interface whose MAC it is addressed to, or
+ * for a broadcast ARP request the interface owning the target IP, unless
+ * -I names one for all of them.  Frames sent by one of our MACs (the
+ * router's own output in an -l log) are skipped.
+ *
+ * With -g the frames come from sr_gen.c instead of a file, and -w writes
+ * them to a pcap file (or "-" for stdout) rather than replaying them.
+ *
+ * With -t it runs microbenchmarks and self checks of single parts of the
+ * router instead (see sr_micro.h), and needs no other options.
+ *
+ * ICMP errors are not rate limited unless -e gives limits (see
+ * sr_icmplimit.h), which then apply in time measured as the bench runs.
+ *
+ * One untimed pass comes first, in which every ARP request the router
+ * sends is answered, so the timed passes see resolved next hops as a
+ * router in steady state would.  No ARP timers run after it, so nothing
+ * expires during the timed passes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_dumper.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_pool.h"
+#include "sr_utils.h"
+#include "sr_protocol.h"
+#include "sr_arpcache.h"
+#include "sr_gen.h"
+#include "sr_icmplimit.h"
+#include "sr_micro.h"
+#include "sr_workers.h"
+
+extern char* optarg;
+
+#define DEFAULT_RTABLE "rtable"
+#define DEFAULT_ROUNDS 100
+#define DEFAULT_FRAMES 10000
+#define SR_BENCH_MAX_ARP 256
+#define SR_BENCH_TX_FRAMES 64   /* frames per writev(..), as SR_TX_FRAMES */
+
+struct sr_bench_frame
+{
+    unsigned int len;
+    unsigned int off;           /* into sr_bench_trace::data */
+    char* iface;
+};
+
+struct sr_bench_trace
+{
+    uint8_t* data;
+    unsigned int data_len;
+    unsigned int data_cap;
+    struct sr_bench_frame* frames;
+    unsigned int n;
+    unsigned int skipped;
+};
+
+/* -- what the stub send path saw -- */
+static unsigned long bench_sent;
+static unsigned long bench_sent_bytes;
+static unsigned int bench_queued;       /* since the last flush */
+static unsigned long bench_flushes;     /* writev(..) calls the VNS path makes */
+static int bench_answer_arp;
+static uint32_t bench_arp_ip[SR_BENCH_MAX_ARP];
+static char bench_arp_if[SR_BENCH_MAX_ARP][sr_IFACE_NAMELEN];
+static unsigned int bench_arp_n;
+
+static void usage(char* argv0)
+{
+    printf("Simple Router Benchmark\n");
+    printf("Format: %s -i ifaces (-f trace.pcap | -g mix) [-r rtable] [-n rounds]\n",argv0);
+    printf("           [-I iface] [-F trie|dir248|sorted] [-c bytes|64|sse2|avx2]\n");
+    printf("           [-N frames to generate] [-w write generated frames to pcap]\n");
+    printf("           [-e ICMP error limits, as for sr] [-W workers] [-v] \n");
+    printf("       %s -t test[,test]   (check: every check, all: everything)\n",argv0);
+    printf("mix: fwd=W,arpreq=W,arprep=W,echo=W,ttl=W,badsum=W,dests=N,zipf=S,len=B,seed=N\n");
+    printf("tests:\n");
+    sr_micro_list(stdout);
+} /* -- usage -- */
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{
+    if(sr->workers && sr_workers_tx(sr->workers, buf, len, iface) == 0)
+    { return 0; }
+    return sr_tx_submit(sr, buf, len, iface);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_submit(..)
+ * Scope: Global
+ *
+ * Stands in for the VNS send path: counts the frame, and the writes
+ * batching would make, and during the warm-up pass remembers ARP requests
+ * so they can be answered.  With workers only the writer thread calls it.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_tx_submit(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                 const char* iface)
+{
+    sr_arp_hdr_t* arp;
+
+    if(sr_micro_tx)
+    {
+        sr_micro_tx(buf, len);
+        return 0;
+    }
+
+    bench_sent++;
+    bench_sent_bytes += len;
+    if(bench_queued == SR_BENCH_TX_FRAMES)
+    {
+        bench_flushes++;
+        bench_queued = 0;
+    }
+    bench_queued++;
+
+    if(bench_answer_arp && bench_arp_n < SR_BENCH_MAX_ARP &&
+       len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t) &&
+       ethertype(buf) == ethertype_arp)
+    {
+        arp = (sr_arp_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+        if(ntohs(arp->ar_op) == arp_op_request)
+        {
+            bench_arp_ip[bench_arp_n] = arp->ar_tip;
+            strncpy(bench_arp_if[bench_arp_n], iface, sr_IFACE_NAMELEN - 1);
+            bench_arp_n++;
+        }
+    }
+    return 0;
+} /* -- sr_tx_submit -- */
+
+/* counts the writes the VNS path would make, as sr_tx_counters(..) does */
+int sr_flush_packets(struct sr_instance* sr)
+{
+    if(bench_queued > 0)
+    {
+        bench_flushes++;
+        bench_queued = 0;
+    }
+    return 0;
+}
+
+/* answer the ARP requests collected by sr_send_packet(..), giving each
+   neighbour a made up MAC */
+static void sr_bench_answer(struct sr_instance* sr)
+{
+    uint8_t frame[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t* ehdr = (sr_ethernet_hdr_t*)frame;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    struct sr_if* iface;
+    unsigned int i, n = bench_arp_n;
+    char name[sr_IFACE_NAMELEN];
+
+    if(n == 0)
+    { return; }
+    bench_arp_n = 0;
+    for(i = 0; i < n; i++)
+    {
+        if((iface = sr_get_interface(sr, bench_arp_if[i])) == 0)
+        { continue; }
+
+        memset(frame, 0, sizeof(frame));
+        memcpy(ehdr->ether_dhost, iface->addr, ETHER_ADDR_LEN);
+        ehdr->ether_shost[0] = 0x02;
+        ehdr->ether_shost[1] = 0xbe;
+        memcpy(ehdr->ether_shost + 2, &(bench_arp_ip[i]), 4);
+        ehdr->ether_type = htons(ethertype_arp);
+        arp->ar_hrd = htons(arp_hrd_ethernet);
+        arp->ar_pro = htons(ethertype_ip);
+        arp->ar_hln = ETHER_ADDR_LEN;
+        arp->ar_pln = 4;
+        arp->ar_op = htons(arp_op_reply);
+        memcpy(arp->ar_sha, ehdr->ether_shost, ETHER_ADDR_LEN);
+        arp->ar_sip = bench_arp_ip[i];
+        memcpy(arp->ar_tha, iface->addr, ETHER_ADDR_LEN);
+        arp->ar_tip = iface->ip;
+
+        strcpy(name, bench_arp_if[i]);
+        sr_handlepacket(sr, frame, sizeof(frame), name);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_load_ifaces(..)
+ * Scope: Local
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_load_ifaces(struct sr_instance* sr, const char* filename)
+{
+    FILE* fp;
+    char line[256];
+    char name[sr_IFACE_NAMELEN];
+    char ip[32];
+    unsigned int m[ETHER_ADDR_LEN];
+    unsigned char mac[ETHER_ADDR_LEN];
+    struct in_addr addr;
+    int i, n = 0;
+
+    if((fp = fopen(filename, "r")) == 0)
+    {
+        perror("fopen(..):sr_bench_load_ifaces");
+        return -1;
+    }
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(line[0] == '#' || line[0] == '\n')
+        { continue; }
+        if(sscanf(line, "%31s %31s %x:%x:%x:%x:%x:%x", name, ip,
+                  &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 8 ||
+           inet_aton(ip, &addr) == 0)
+        {
+            fprintf(stderr, "Error: bad interface line: %s", line);
+            fclose(fp);
+            return -1;
+        }
+        for(i = 0; i < ETHER_ADDR_LEN; i++)
+        { mac[i] = m[i]; }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, addr.s_addr);
+        n++;
+    }
+
+    fclose(fp);
+    if(n == 0)
+    {
+        fprintf(stderr, "Error: no interfaces in %s\n", filename);
+        return -1;
+    }
+    return 0;
+} /* -- sr_bench_load_ifaces -- */
+
+/* space for a frame of up to len bytes at the end of the trace */
+static uint8_t* sr_bench_room(struct sr_bench_trace* t, unsigned int len)
+{
+    if(t->data_len + len > t->data_cap)
+    {
+        t->data_cap = t->data_cap ? t->data_cap * 2 : 1 << 20;
+        t->data = (uint8_t*)realloc(t->data, t->data_cap);
+        assert(t->data);
+    }
+    return t->data + t->data_len;
+}
+
+/* keep the len bytes just written at sr_bench_room(..) as a frame */
+static void sr_bench_append(struct sr_bench_trace* t, unsigned int len,
+                            char* iface)
+{
+    if((t->n & (t->n - 1)) == 0)
+    {
+        t->frames = (struct sr_bench_frame*)realloc(t->frames,
+                (t->n ? t->n * 2 : 1) * sizeof(struct sr_bench_frame));
+        assert(t->frames);
+    }
+    t->frames[t->n].len = len;
+    t->frames[t->n].off = t->data_len;
+    t->frames[t->n].iface = iface;
+    t->n++;
+    t->data_len += len;
+}
+
+/* the interface a frame came in on, or 0 to skip it */
+static struct sr_if* sr_bench_ingress(struct sr_instance* sr, uint8_t* buf,
+                                      unsigned int len)
+{
+    sr_ethernet_hdr_t* ehdr = (sr_ethernet_hdr_t*)buf;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    struct sr_if* iface;
+
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        if(memcmp(ehdr->ether_shost, iface->addr, ETHER_ADDR_LEN) == 0)
+        { return 0; }
+    }
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        if(memcmp(ehdr->ether_dhost, iface->addr, ETHER_ADDR_LEN) == 0)
+        { return iface; }
+    }
+
+    if(ethertype(buf) == ethertype_arp &&
+       len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+    {
+        for(iface = sr->if_list; iface; iface = iface->next)
+        {
+            if(arp->ar_tip == iface->ip)
+            { return iface; }
+        }
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_load_trace(..)
+ * Scope: Local
+ *
+ * Read every frame of a pcap file into one buffer and pick its ingress
+ * interface.  force, if given, is used for all of them.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_load_trace(struct sr_instance* sr, const char* filename,
+                               const char* force, struct sr_bench_trace* t)
+{
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    struct sr_if* iface;
+    struct sr_if* forced = 0;
+    uint8_t* frame;
+    FILE* fp;
+
+    memset(t, 0, sizeof(*t));
+
+    if(force && (forced = sr_get_interface(sr, force)) == 0)
+    {
+        fprintf(stderr, "Error: no interface %s\n", force);
+        return -1;
+    }
+
+    if((fp = fopen(filename, "rb")) == 0)
+    {
+        perror("fopen(..):sr_bench_load_trace");
+        return -1;
+    }
+    if(fread(&fh, sizeof(fh), 1, fp) != 1 || fh.magic != TCPDUMP_MAGIC ||
+       fh.linktype != LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "Error: %s is not an ethernet pcap file in host byte order\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    while(fread(&ph, sizeof(ph), 1, fp) == 1)
+    {
+        if(ph.caplen > fh.snaplen || ph.caplen > 65535)
+        {
+            fprintf(stderr, "Error: bad record in %s\n", filename);
+            break;
+        }
+        frame = sr_bench_room(t, ph.caplen);
+        if(fread(frame, 1, ph.caplen, fp) != ph.caplen)
+        { break; }
+
+        if(ph.caplen < sizeof(sr_ethernet_hdr_t) ||
+           (iface = forced ? forced :
+                    sr_bench_ingress(sr, frame, ph.caplen)) == 0)
+        {
+            t->skipped++;
+            continue;
+        }
+        sr_bench_append(t, ph.caplen, iface->name);
+    }
+
+    fclose(fp);
+    return 0;
+} /* -- sr_bench_load_trace -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_bench_gen_trace(..)
+ * Scope: Local
+ *
+ * Fill the trace with frames from the generator instead of a file.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_bench_gen_trace(struct sr_instance* sr, const char* spec,
+                              unsigned int frames, struct sr_bench_trace* t)
+{
+    struct sr_gen* g;
+    const char* iface;
+    unsigned int i, len;
+    int k;
+
+    memset(t, 0, sizeof(*t));
+    if((g = sr_gen_create(sr, spec)) == 0)
+    { return -1; }
+
+    for(i = 0; i < frames; i++)
+    {
+        len = sr_gen_next(g, sr_bench_room(t, SR_GEN_MAX_FRAME), &iface);
+        sr_bench_append(t, len, (char*)iface);
+    }
+
+    fprintf(stderr, "generated:");
+    for(k = 0; k < sr_gen_kinds; k++)
+    { fprintf(stderr, " %s %lu", sr_gen_kind_name(k), g->count[k]); }
+    fprintf(stderr, ", %u destinations\n", g->dests);
+
+    sr_gen_destroy(g);
+    return 0;
+} /* -- sr_bench_gen_trace -- */
+
+/* write the trace out as a pcap file, a microsecond between frames */
+static int sr_bench_write_trace(struct sr_bench_trace* t, const char* filename)
+{
+    struct pcap_pkthdr h;
+    FILE* fp;
+    unsigned int i;
+
+    if((fp = sr_dump_open(filename, 0, 65535)) == 0)
+    { return -1; }
+
+    gettimeofday(&h.ts, 0);
+    for(i = 0; i < t->n; i++)
+    {
+        h.caplen = h.len = t->frames[i].len;
+        sr_dump(fp, &h, t->data + t->frames[i].off);
+        if(++h.ts.tv_usec == 1000000)
+        {
+            h.ts.tv_sec++;
+            h.ts.tv_usec = 0;
+        }
+    }
+
+    sr_dump_close(fp);
+    return 0;
+}
+
+/* replay the trace once, through a copy of each frame since the router
+   rewrites them in place, as a receive path would have copied it.  In
+   the warm-up pass ARP timers are run and answered after every frame. */
+static void sr_bench_replay(struct sr_instance* sr, struct sr_bench_trace* t,
+                            uint8_t* buf)
+{
+    struct sr_bench_frame* f;
+    unsigned int i;
+
+    for(i = 0; i < t->n; i++)
+    {
+        f = &(t->frames[i]);
+        if(sr->workers)
+        {
+            /* -- copied into a pool buffer on the way -- */
+            sr_workers_dispatch(sr->workers, t->data + f->off, f->len, f->iface);
+            continue;
+        }
+        memcpy(buf, t->data + f->off, f->len);
+        sr_handlepacket(sr, buf, f->len, f->iface);
+        /* -- as the receive loop does after a read, here of one frame -- */
+        sr_flush_packets(sr);
+        if(bench_answer_arp)
+        {
+            /* -- new requests are sent from the timer wheel -- */
+            sr_arpcache_tick(sr);
+            sr_bench_answer(sr);
+        }
+    }
+}
+
+/* the untimed pass: replay once, then keep running the ARP timers until
+   every queued packet has gone out or been given up on */
+static void sr_bench_warm(struct sr_instance* sr, struct sr_bench_trace* t,
+                          uint8_t* buf)
+{
+    struct timespec ms = { 0, 1000000 };
+    unsigned int i;
+
+    bench_answer_arp = 1;
+    sr_bench_replay(sr, t, buf);
+    for(i = 0; sr->cache.requests && i < 10000; i++)
+    {
+        nanosleep(&ms, 0);
+        sr_arpcache_tick(sr);
+        sr_bench_answer(sr);
+    }
+    bench_answer_arp = 0;
+    bench_arp_n = 0;
+}
+
+static double sr_bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    char *rtable = DEFAULT_RTABLE;
+    char *ifaces = 0;
+    char *trace = 0;
+    char *force = 0;
+    char *kernel = 0;
+    char *mix = 0;
+    char *limits = 0;
+    char *out_trace = 0;
+    char *tests = 0;
+    unsigned int frames = DEFAULT_FRAMES;
+    unsigned int workers = 0;
+    unsigned int rounds = DEFAULT_ROUNDS;
+    int fib_engine = fib_engine_trie;
+    int verbose = 0;
+    int out = -1, null;
+    struct sr_instance sr;
+    struct sr_bench_trace t;
+    uint8_t* buf;
+    unsigned long allocs, misses, sent, bytes, flushes, packets;
+    struct sr_arpq_stats qstats;
+    unsigned int i;
+    double start, secs;
+
+    while ((c = getopt(argc, argv, "hr:i:f:n:I:F:c:vg:N:w:e:t:W:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'i':
+                ifaces = optarg;
+                break;
+            case 'f':
+                trace = optarg;
+                break;
+            case 'n':
+                rounds = atoi((char *) optarg);
+                break;
+            case 'I':
+                force = optarg;
+                break;
+            case 'F':
+                if(strcmp(optarg, "trie") == 0)
+                { fib_engine = fib_engine_trie; }
+                else if(strcmp(optarg, "dir248") == 0)
+                { fib_engine = fib_engine_dir248; }
+                else if(strcmp(optarg, "sorted") == 0)
+                { fib_engine = fib_engine_sorted; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'c':
+                kernel = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'g':
+                mix = optarg;
+                break;
+            case 'N':
+                frames = atoi((char *) optarg);
+                break;
+            case 'w':
+                out_trace = optarg;
+                break;
+            case 'e':
+                limits = optarg;
+                break;
+            case 't':
+                tests = optarg;
+                break;
+            case 'W':
+                workers = atoi((char *) optarg);
+                break;
+            default:
+                usage(argv[0]);
+                exit(1);
+        } /* switch */
+    } /* -- while -- */
+
+    if(tests)
+    { return sr_micro_run(tests) == 0 ? 0 : 1; }
+    if(ifaces == 0 || (trace == 0) == (mix == 0) || rounds == 0 ||
+       (out_trace && mix == 0))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    if(kernel && cksum_use(kernel) != 0)
+    {
+        fprintf(stderr, "Error: checksum kernel %s not available\n", kernel);
+        exit(1);
+    }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.fib_engine = fib_engine;
+    sr.event_loop = 1;          /* no ARP thread; nothing expires mid-run */
+    sr.pool = sr_pool_create(SR_POOL_BUF_SZ, SR_POOL_BUFS);
+    if(limits)
+    {
+        sr.icmplimit = sr_icmplimit_create();
+        if(sr_icmplimit_parse(sr.icmplimit, limits) != 0)
+        { exit(1); }
+    }
+
+    if(sr_bench_load_ifaces(&sr, ifaces) != 0)
+    { exit(1); }
+    if(sr_load_rt(&sr, rtable) != 0)
+    {
+        fprintf(stderr,"Error setting up routing table from file %s\n",
+                rtable);
+        exit(1);
+    }
+    sr_init(&sr);
+    if(mix)
+    {
+        if(sr_bench_gen_trace(&sr, mix, frames, &t) != 0)
+        { exit(1); }
+        if(out_trace)
+        { return sr_bench_write_trace(&t, out_trace) == 0 ? 0 : 1; }
+    }
+    else if(sr_bench_load_trace(&sr, trace, force, &t) != 0)
+    { exit(1); }
+    if(t.n == 0)
+    {
+        fprintf(stderr, "Error: no frames to replay in %s (%u skipped)\n",
+                trace, t.skipped);
+        exit(1);
+    }
+    buf = (uint8_t*)malloc(65536);
+    assert(buf);
+
+    /* -- the router logs every packet to stdout; keep that out of the
+          way unless asked for, but still pay for producing it -- */
+    fflush(stdout);
+    if(!verbose)
+    {
+        out = dup(STDOUT_FILENO);
+        if((null = open("/dev/null", O_WRONLY)) >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+    }
+
+    sr_bench_warm(&sr, &t, buf);
+
+    allocs = sr_pkt_alloc_count();
+    misses = sr_pool_misses(sr.pool);
+    sent = bench_sent;
+    bytes = bench_sent_bytes;
+    flushes = bench_flushes;
+    start = sr_bench_now();
+    if(workers && (sr.workers = sr_workers_start(&sr, workers)) == 0)
+    { exit(1); }
+    for(i = 0; i < rounds; i++)
+    { sr_bench_replay(&sr, &t, buf); }
+    sr_workers_stop(sr.workers);
+    sr.workers = 0;
+    secs = sr_bench_now() - start;
+    allocs = sr_pkt_alloc_count() - allocs;
+    misses = sr_pool_misses(sr.pool) - misses;
+    sent = bench_sent - sent;
+    bytes = bench_sent_bytes - bytes;
+    flushes = bench_flushes - flushes;
+
+    fflush(stdout);
+    if(out >= 0)
+    {
+        dup2(out, STDOUT_FILENO);
+        close(out);
+    }
+
+    packets = (unsigned long)t.n * rounds;
+    printf("frames:        %u from %s (%u skipped), %u rounds, %u workers\n",
+           t.n, trace ? trace : mix, t.skipped, rounds, workers);
+    printf("packets:       %lu in %.3f s\n", packets, secs);
+    printf("rate:          %.0f pps\n", packets / secs);
+    printf("time:          %.1f ns/packet\n", secs * 1e9 / packets);
+    printf("allocations:   %.3f /packet (%lu pool misses, %lu of %u buffers "
+           "still in use)\n", (double)allocs / packets, misses,
+           sr_pool_in_use(sr.pool), sr.pool ? sr.pool->count : 0);
+    printf("sent:          %.3f frames/packet, %lu bytes\n",
+           (double)sent / packets, bytes);
+    printf("tx batching:   %.1f frames per flush, %lu syscalls saved\n",
+           flushes ? (double)sent / flushes : 0.0, sent - flushes);
+    sr_arpcache_queue_stats(&(sr.cache), &qstats);
+    printf("arp queue:     %lu queued, %lu drained, %lu dropped, %lu failed\n",
+           qstats.queued, qstats.drained, qstats.dropped, qstats.failed);
+    sr_icmplimit_print(sr.icmplimit, stdout);
+
+    free(buf);
+    free(t.frames);
+    free(t.data);
+    return 0;
+} /* -- main -- */
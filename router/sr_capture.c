@@ -0,0 +1,230 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Description:
+ *
+ * Asynchronous pcap capture, see sr_capture.h.  The ring is the bounded
+ * queue where every slot holds a sequence number: a producer may fill the
+ * slot for position pos when its sequence is pos, and publishes it by
+ * setting pos + 1; the writer hands the slot back for the next lap by
+ * setting pos + SR_CAPTURE_SLOTS.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "sr_capture.h"
+#include "sr_dumper.h"
+
+#define SR_CAPTURE_MASK (SR_CAPTURE_SLOTS - 1)
+
+/* write out what has been batched so far */
+static void sr_capture_flush(struct sr_capture* c)
+{
+    if ( c->batch_len == 0 )
+    { return; }
+
+    if ( fwrite(c->batch, 1, c->batch_len, c->fp) != c->batch_len )
+    { perror("fwrite(..):sr_capture"); }
+    fflush(c->fp);
+    c->batch_len = 0;
+}
+
+/* move every published slot into the batch; returns how many */
+static unsigned int sr_capture_drain(struct sr_capture* c)
+{
+    struct sr_capture_slot* s;
+    struct pcap_pkthdr h;
+    unsigned int n = 0;
+
+    while ( 1 )
+    {
+        s = &(c->slot[c->head & SR_CAPTURE_MASK]);
+        if ( __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE) != c->head + 1 )
+        { break; }
+
+        if ( c->batch_len + sizeof(struct pcap_sf_pkthdr) + s->caplen >
+             SR_CAPTURE_BUF_SZ )
+        { sr_capture_flush(c); }
+
+        h.ts = s->ts;
+        h.caplen = s->caplen;
+        h.len = s->len;
+        c->batch_len += sr_dump_record(c->batch + c->batch_len, &h, s->data);
+
+        __atomic_store_n(&(s->seq), c->head + SR_CAPTURE_SLOTS,
+                         __ATOMIC_RELEASE);
+        c->head++;
+        n++;
+    }
+
+    c->written += n;
+    return n;
+}
+
+static int sr_capture_empty(struct sr_capture* c)
+{
+    struct sr_capture_slot* s = &(c->slot[c->head & SR_CAPTURE_MASK]);
+    return __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE) != c->head + 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_writer(..)
+ * Scope:  Local
+ *
+ * Drain the ring until told to stop, writing whenever it runs dry so the
+ * file never lags far behind, then sleep until a producer rings.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_capture_writer(void* arg)
+{
+    struct sr_capture* c = (struct sr_capture*)arg;
+
+    while ( 1 )
+    {
+        if ( sr_capture_drain(c) > 0 )
+        { continue; }
+
+        sr_capture_flush(c);
+        if ( __atomic_load_n(&(c->stop), __ATOMIC_ACQUIRE) &&
+             sr_capture_empty(c) )
+        { break; }
+
+        sr_bell_prepare(&(c->bell));
+        sr_bell_sleep(&(c->bell), sr_capture_empty(c) &&
+                      !__atomic_load_n(&(c->stop), __ATOMIC_ACQUIRE));
+    }
+
+    return 0;
+} /* -- sr_capture_writer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_start(..)
+ * Scope:  Global
+ *
+ * Start capturing to fp, already opened with sr_dump_open(..).  fp stays
+ * the caller's.  Returns 0 if the writer could not be started.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_start(FILE* fp, int policy)
+{
+    struct sr_capture* c;
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(fp);
+
+    c = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    assert(c);
+    c->fp = fp;
+    c->policy = policy;
+    c->slot = (struct sr_capture_slot*)malloc(SR_CAPTURE_SLOTS *
+                                              sizeof(struct sr_capture_slot));
+    c->batch = (uint8_t*)malloc(SR_CAPTURE_BUF_SZ);
+    assert(c->slot && c->batch);
+    for ( i = 0; i < SR_CAPTURE_SLOTS; i++ )
+    { c->slot[i].seq = i; }
+    sr_bell_init(&(c->bell));
+
+    if ( pthread_create(&(c->writer), 0, sr_capture_writer, c) != 0 )
+    {
+        perror("pthread_create(..):sr_capture_start");
+        free(c->slot);
+        free(c->batch);
+        free(c);
+        return 0;
+    }
+
+    return c;
+} /* -- sr_capture_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_stop(..)
+ * Scope:  Global
+ *
+ * Write out everything captured and stop the writer.  Nothing may call
+ * sr_capture_put(..) any more.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_capture_stop(struct sr_capture* c)
+{
+    if ( c == 0 )
+    { return; }
+
+    __atomic_store_n(&(c->stop), 1, __ATOMIC_RELEASE);
+    sr_bell_ring(&(c->bell));
+    pthread_join(c->writer, 0);
+
+    fprintf(stderr, "capture: %lu frames written, %lu dropped\n",
+            c->written, sr_capture_dropped(c));
+
+    free(c->slot);
+    free(c->batch);
+    free(c);
+} /* -- sr_capture_stop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_capture_put(..)
+ * Scope:  Global
+ *
+ * Queue the first PACKET_DUMP_SIZE bytes of a frame for the file.
+ * Returns -1 if the ring was full and the frame dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_capture_put(struct sr_capture* c, const uint8_t* buf, unsigned int len)
+{
+    struct sr_capture_slot* s;
+    unsigned int pos, seq;
+
+    pos = __atomic_load_n(&(c->tail), __ATOMIC_RELAXED);
+    while ( 1 )
+    {
+        s = &(c->slot[pos & SR_CAPTURE_MASK]);
+        seq = __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE);
+
+        if ( seq == pos )
+        {
+            /* -- ours if nobody else claimed it meanwhile -- */
+            if ( __atomic_compare_exchange_n(&(c->tail), &pos, pos + 1, 1,
+                                             __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED) )
+            { break; }
+        }
+        else if ( (int)(seq - pos) < 0 )
+        {
+            /* -- the writer has not freed it yet: full -- */
+            if ( c->policy == sr_capture_drop )
+            {
+                __atomic_add_fetch(&(c->dropped), 1, __ATOMIC_RELAXED);
+                return -1;
+            }
+            sr_bell_ring(&(c->bell));
+            sched_yield();
+            pos = __atomic_load_n(&(c->tail), __ATOMIC_RELAXED);
+        }
+        else
+        { pos = __atomic_load_n(&(c->tail), __ATOMIC_RELAXED); }
+    }
+
+    gettimeofday(&(s->ts), 0);
+    s->len = len;
+    s->caplen = len < PACKET_DUMP_SIZE ? len : PACKET_DUMP_SIZE;
+    memcpy(s->data, buf, s->caplen);
+    __atomic_store_n(&(s->seq), pos + 1, __ATOMIC_RELEASE);
+
+    sr_bell_ring(&(c->bell));
+    return 0;
+} /* -- sr_capture_put -- */
+
+unsigned long sr_capture_dropped(struct sr_capture* c)
+{
+    return __atomic_load_n(&(c->dropped), __ATOMIC_RELAXED);
+}
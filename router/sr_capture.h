@@ -0,0 +1,79 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Description:
+ *
+ * Packet capture for -l off the forwarding path.  sr_log_packet(..) only
+ * copies the frame into a slot of a bounded ring; a writer thread drains
+ * the ring, formats the records with sr_dump_record(..) into a large
+ * buffer and writes that out when it fills or the ring runs dry.
+ *
+ * Any thread may log (the reader, workers, the transmit writer), so the
+ * ring is multi-producer: each slot carries a sequence number saying
+ * whose turn it is, producers claim positions with a compare-and-swap on
+ * tail and nobody takes a lock.  When the ring is full a frame is either
+ * dropped and counted or, with the block policy, the producer waits for
+ * the writer to make room.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_CAPTURE_H
+#define sr_CAPTURE_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_router.h"
+#include "sr_workers.h"
+
+#define SR_CAPTURE_SLOTS    4096        /* a power of two */
+#define SR_CAPTURE_BUF_SZ   (1 << 20)   /* bytes written to the file at once */
+
+enum sr_capture_policy
+{
+    sr_capture_drop = 0,        /* drop the frame when the ring is full */
+    sr_capture_block            /* wait for the writer */
+};
+
+struct sr_capture_slot
+{
+    unsigned int seq;           /* pos: free for pos, pos + 1: holds pos */
+    unsigned int len;           /* on the wire */
+    unsigned int caplen;
+    struct timeval ts;
+    uint8_t data[PACKET_DUMP_SIZE];
+};
+
+struct sr_capture
+{
+    unsigned int tail;          /* next position to claim, producers */
+    char pad0[SR_CACHELINE - sizeof(unsigned int)];
+    unsigned int head;          /* next position to write, writer only */
+    char pad1[SR_CACHELINE - sizeof(unsigned int)];
+    struct sr_capture_slot* slot;
+    FILE* fp;
+    uint8_t* batch;             /* records not yet written */
+    unsigned int batch_len;
+    int policy;
+    pthread_t writer;
+    struct sr_bell bell;        /* the writer's */
+    int stop;
+    unsigned long written;
+    unsigned long dropped;
+};
+
+struct sr_capture* sr_capture_start(FILE* fp, int policy);
+void sr_capture_stop(struct sr_capture* );
+int sr_capture_put(struct sr_capture* , const uint8_t* buf, unsigned int len);
+unsigned long sr_capture_dropped(struct sr_capture* );
+
+#endif  /* --  sr_CAPTURE_H -- */
@@ -0,0 +1,195 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dir248.c
+ *
+ * Description:
+ *
+ * DIR-24-8 table construction.  Every slot remembers the length of the
+ * prefix that filled it, so routes can be added in any order: a slot is
+ * only overwritten by a strictly longer prefix.  That also keeps the first
+ * of two identical prefixes, like the trie and the old list walk.
+ *
+ * Building costs 48MB for the first level plus 768 bytes per split /24,
+ * which is the price of a lookup that does not depend on the table size.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_dir248.h"
+
+#define SR_DIR248_TBL24_SZ (1 << 24)
+#define SR_DIR248_GROUP_SZ 256
+
+/*---------------------------------------------------------------------
+ * Method: sr_dir248_create()
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_dir248* sr_dir248_create(void)
+{
+    struct sr_dir248* d;
+
+    d = (struct sr_dir248*)calloc(1, sizeof(struct sr_dir248));
+    assert(d);
+
+    d->tbl24   = (uint16_t*)calloc(SR_DIR248_TBL24_SZ, sizeof(uint16_t));
+    d->depth24 = (uint8_t*)calloc(SR_DIR248_TBL24_SZ, sizeof(uint8_t));
+    if(d->tbl24 == 0 || d->depth24 == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_dir248_create)\n");
+        sr_dir248_destroy(d);
+        return 0;
+    }
+
+    return d;
+} /* -- sr_dir248_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_dir248_destroy(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_dir248_destroy(struct sr_dir248* d)
+{
+    if(d == 0)
+    { return; }
+
+    free(d->tbl24);
+    free(d->depth24);
+    free(d->tbl8);
+    free(d->depth8);
+    free(d);
+} /* -- sr_dir248_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_dir248_split(..)
+ * Scope:  Local
+ *
+ * Give first level slot i its own tbl8 group, seeded with whatever the
+ * slot currently resolves to.  Returns the group number or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_dir248_split(struct sr_dir248* d, uint32_t i)
+{
+    unsigned int g, j;
+    uint16_t* tbl8;
+    uint8_t* depth8;
+
+    if(d->groups == d->groups_cap)
+    {
+        unsigned int cap = d->groups_cap ? d->groups_cap * 2 : 64;
+        if(cap > SR_DIR248_MAX_NH + 1)
+        { cap = SR_DIR248_MAX_NH + 1; }
+        if(cap == d->groups_cap)
+        { return -1; }
+
+        tbl8 = (uint16_t*)realloc(d->tbl8,
+                cap * SR_DIR248_GROUP_SZ * sizeof(uint16_t));
+        if(tbl8 == 0)
+        { return -1; }
+        d->tbl8 = tbl8;
+
+        depth8 = (uint8_t*)realloc(d->depth8, cap * SR_DIR248_GROUP_SZ);
+        if(depth8 == 0)
+        { return -1; }
+        d->depth8 = depth8;
+
+        d->groups_cap = cap;
+    }
+
+    g = d->groups++;
+    tbl8 = d->tbl8 + g * SR_DIR248_GROUP_SZ;
+    depth8 = d->depth8 + g * SR_DIR248_GROUP_SZ;
+    for(j = 0; j < SR_DIR248_GROUP_SZ; j++)
+    {
+        tbl8[j] = d->tbl24[i];
+        depth8[j] = d->depth24[i];
+    }
+
+    d->tbl24[i] = SR_DIR248_EXT | g;
+    return g;
+} /* -- sr_dir248_split -- */
+
+/* fill count entries from tbl/depth where a shorter prefix owns them */
+static void sr_dir248_fill(uint16_t* tbl, uint8_t* depth, uint32_t count,
+                           uint16_t nh, uint8_t d)
+{
+    uint32_t j;
+    for(j = 0; j < count; j++)
+    {
+        if(depth[j] < d)
+        {
+            tbl[j] = nh;
+            depth[j] = d;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_dir248_insert(..)
+ * Scope:  Global
+ *
+ * Add prefix/len (host byte order) -> nh.  Returns 0 on success, -1 if
+ * the next hop does not fit or the second level is exhausted.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_dir248_insert(struct sr_dir248* d, uint32_t prefix, int len,
+                     uint16_t nh)
+{
+    uint8_t depth = len + 1;
+    uint32_t i, start, count;
+    int g;
+
+    /* -- REQUIRES -- */
+    assert(d);
+
+    if(len < 0 || len > 32 || nh == 0 || nh > SR_DIR248_MAX_NH)
+    { return -1; }
+
+    prefix &= len ? (0xffffffffU << (32 - len)) : 0;
+
+    if(len <= 24)
+    {
+        start = prefix >> 8;
+        count = 1U << (24 - len);
+        for(i = start; i < start + count; i++)
+        {
+            if(d->tbl24[i] & SR_DIR248_EXT)
+            {
+                g = d->tbl24[i] & SR_DIR248_MAX_NH;
+                sr_dir248_fill(d->tbl8 + g * SR_DIR248_GROUP_SZ,
+                               d->depth8 + g * SR_DIR248_GROUP_SZ,
+                               SR_DIR248_GROUP_SZ, nh, depth);
+            }
+            else if(d->depth24[i] < depth)
+            {
+                d->tbl24[i] = nh;
+                d->depth24[i] = depth;
+            }
+        }
+        return 0;
+    }
+
+    i = prefix >> 8;
+    if(d->tbl24[i] & SR_DIR248_EXT)
+    { g = d->tbl24[i] & SR_DIR248_MAX_NH; }
+    else if((g = sr_dir248_split(d, i)) < 0)
+    {
+        fprintf(stderr, "Error: DIR-24-8 second level full\n");
+        return -1;
+    }
+
+    start = prefix & 0xff;
+    count = 1U << (32 - len);
+    sr_dir248_fill(d->tbl8 + g * SR_DIR248_GROUP_SZ + start,
+                   d->depth8 + g * SR_DIR248_GROUP_SZ + start,
+                   count, nh, depth);
+    return 0;
+} /* -- sr_dir248_insert -- */
@@ -0,0 +1,49 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dir248.h
+ *
+ * Description:
+ *
+ * DIR-24-8 forwarding table.  The first level is a directly indexed array
+ * covering the top 24 bits of the address; prefixes longer than /24 hang
+ * off 256-entry second level groups.  A lookup is one memory access, or
+ * two when the /24 has been split.
+ *
+ * Entries are next-hop indices into sr_instance::nexthops, not routes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_DIR248_H
+#define sr_DIR248_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_DIR248_EXT      0x8000   /* entry refers to a tbl8 group */
+#define SR_DIR248_MAX_NH   0x7fff   /* largest next-hop index we can store */
+
+struct sr_dir248
+{
+    uint16_t* tbl24;         /* 2^24 entries, nh index or EXT|group */
+    uint8_t*  depth24;       /* prefix length + 1 owning each entry, 0 if none */
+    uint16_t* tbl8;          /* groups of 256 entries */
+    uint8_t*  depth8;
+    unsigned int groups;     /* tbl8 groups in use */
+    unsigned int groups_cap;
+};
+
+struct sr_dir248* sr_dir248_create(void);
+void sr_dir248_destroy(struct sr_dir248* );
+int sr_dir248_insert(struct sr_dir248* , uint32_t prefix, int len, uint16_t nh);
+
+/* ip in host byte order, returns next-hop index or 0 */
+#define sr_dir248_lookup(d, ip) \
+    (((d)->tbl24[(ip) >> 8] & SR_DIR248_EXT) ? \
+     (d)->tbl8[(((d)->tbl24[(ip) >> 8] & SR_DIR248_MAX_NH) << 8) | ((ip) & 0xff)] : \
+     (d)->tbl24[(ip) >> 8])
+
+#endif  /* --  sr_DIR248_H -- */
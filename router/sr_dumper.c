@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <string.h>
 #include "sr_dumper.h"
 
 static void
@@ -63,6 +64,26 @@ sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp)
         (void)fwrite((char *)sp, h->caplen, 1, fp);
 }
 
+/*
+ * Format a packet record into buf, which must hold
+ * sizeof(struct pcap_sf_pkthdr) + h->caplen bytes, for writing later.
+ * Returns the number of bytes used.
+ */
+unsigned int
+sr_dump_record(unsigned char *buf, const struct pcap_pkthdr *h,
+               const unsigned char *sp)
+{
+        struct pcap_sf_pkthdr sf_hdr;
+
+        sf_hdr.ts.tv_sec  = h->ts.tv_sec;
+        sf_hdr.ts.tv_usec = h->ts.tv_usec;
+        sf_hdr.caplen     = h->caplen;
+        sf_hdr.len        = h->len;
+        memcpy(buf, &sf_hdr, sizeof(sf_hdr));
+        memcpy(buf + sizeof(sf_hdr), sp, h->caplen);
+        return sizeof(sf_hdr) + h->caplen;
+}
+
 void
 sr_dump_close(FILE *fp)
 {
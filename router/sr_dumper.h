@@ -73,6 +73,12 @@ FILE* sr_dump_open(const char *fname, int thiszone, int snaplen);
  */
 void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
 
+/**
+ * Format a record into memory instead, for batched writes
+ */
+unsigned int sr_dump_record(unsigned char *buf, const struct pcap_pkthdr *h,
+                            const unsigned char *sp);
+
 /**
  * Close the file
  */
@@ -0,0 +1,466 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_gen.c
+ *
+ * Description:
+ *
+ * Synthetic traffic generator, see sr_gen.h.  Destinations are drawn once
+ * when the generator is created; each frame then picks one of them, by
+ * Zipf rank or uniformly, so a run has a fixed working set like real
+ * traffic does.  A small xorshift generator keeps runs repeatable for a
+ * given seed whatever the C library.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "sr_gen.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+
+#define SR_GEN_UDP_LEN 8
+#define SR_GEN_ECHO_LEN 8       /* sr_icmp_hdr_t plus identifier and sequence */
+
+struct sr_gen_dest
+{
+    uint32_t ip;                /* network byte order */
+    uint32_t nh;                /* next hop towards ip */
+    struct sr_if* out;          /* interface it is routed out of */
+};
+
+static const char* sr_gen_names[sr_gen_kinds] =
+{ "fwd", "arpreq", "arprep", "echo", "ttl", "badsum" };
+
+const char* sr_gen_kind_name(int kind)
+{
+    return sr_gen_names[kind];
+}
+
+static uint32_t sr_gen_rand(struct sr_gen* g)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return (uint32_t)((g->rng * 2685821657736338717ULL) >> 32);
+}
+
+/* uniform in [0, 1) */
+static double sr_gen_uniform(struct sr_gen* g)
+{
+    return sr_gen_rand(g) / 4294967296.0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_gen_parse(..)
+ * Scope:  Local
+ *
+ * Read "key=value,..." into g.  Returns -1 on an unknown key or a value
+ * that is not a number in range for its key.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_gen_parse(struct sr_gen* g, const char* spec)
+{
+    char key[32];
+    const char* p = spec;
+    const char* eq;
+    const char* end;
+    char* stop;
+    unsigned long val = 0;
+    double zipf = 0;
+    int k, bad;
+
+    while(*p)
+    {
+        if((end = strchr(p, ',')) == 0)
+        { end = p + strlen(p); }
+        eq = memchr(p, '=', end - p);
+        if(eq == 0 || eq - p >= (int)sizeof(key))
+        {
+            fprintf(stderr, "Error: bad traffic spec %s\n", spec);
+            return -1;
+        }
+        memcpy(key, p, eq - p);
+        key[eq - p] = 0;
+
+        /* -- a digit first, so neither parser takes a sign or blanks -- */
+        errno = 0;
+        if(strcmp(key, "zipf") == 0)
+        { zipf = strtod(eq + 1, &stop); }
+        else
+        { val = strtoul(eq + 1, &stop, 10); }
+        bad = eq[1] < '0' || eq[1] > '9' || stop != end || errno == ERANGE;
+
+        for(k = 0; k < sr_gen_kinds; k++)
+        {
+            if(strcmp(key, sr_gen_names[k]) == 0)
+            { break; }
+        }
+        if(k < sr_gen_kinds)
+        {
+            bad = bad || val > SR_GEN_MAX_WEIGHT;
+            g->weight[k] = val;
+        }
+        else if(strcmp(key, "dests") == 0)
+        {
+            bad = bad || val > SR_GEN_MAX_DESTS;
+            g->dests = val;
+        }
+        else if(strcmp(key, "zipf") == 0)
+        { g->zipf = zipf; }
+        else if(strcmp(key, "len") == 0)
+        {
+            bad = bad || val > SR_GEN_MAX_LEN;
+            g->len = val;
+        }
+        else if(strcmp(key, "seed") == 0)
+        { g->rng = val; }
+        else
+        {
+            fprintf(stderr, "Error: unknown traffic spec key %s\n", key);
+            return -1;
+        }
+        if(bad)
+        {
+            fprintf(stderr, "Error: bad %s in traffic spec %s\n", key, spec);
+            return -1;
+        }
+
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+} /* -- sr_gen_parse -- */
+
+/* a random host in route r, network byte order */
+static uint32_t sr_gen_host(struct sr_gen* g, struct sr_rt* r)
+{
+    uint32_t mask = ntohl(r->mask.s_addr);
+    uint32_t host = ~mask;
+
+    /* -- keep clear of the network and broadcast addresses if we can -- */
+    if(host >= 3)
+    { host = 1 + sr_gen_rand(g) % (host - 1); }
+    else
+    { host &= sr_gen_rand(g); }
+
+    return htonl((ntohl(r->dest.s_addr) & mask) | host);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_gen_create(..)
+ * Scope:  Global
+ *
+ * Set up a generator over sr's interfaces and routes.  Returns 0, having
+ * said why, if the spec is bad or the router has nothing to send to.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_gen* sr_gen_create(struct sr_instance* sr, const char* spec)
+{
+    struct sr_gen* g;
+    struct sr_rt** routes = 0;
+    struct sr_rt* r;
+    struct sr_if* iface;
+    unsigned int nroutes = 0, i, total = 0;
+    double sum = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(spec);
+
+    g = (struct sr_gen*)calloc(1, sizeof(struct sr_gen));
+    assert(g);
+    g->sr = sr;
+    g->dests = 1000;
+    g->len = 64;
+    g->rng = 1;
+
+    if(sr_gen_parse(g, spec) != 0)
+    { goto fail; }
+    if(g->rng == 0)
+    { g->rng = 1; }
+    if(g->len < SR_GEN_UDP_LEN)
+    { g->len = SR_GEN_UDP_LEN; }
+    if(g->len > SR_GEN_MAX_LEN - sizeof(sr_ip_hdr_t))
+    { g->len = SR_GEN_MAX_LEN - sizeof(sr_ip_hdr_t); }
+    for(i = 0; i < sr_gen_kinds; i++)
+    { total += g->weight[i]; }
+    if(total == 0)
+    { g->weight[sr_gen_fwd] = 100; }
+
+    for(iface = sr->if_list; iface; iface = iface->next)
+    { g->nifs++; }
+    if(g->nifs == 0)
+    {
+        fprintf(stderr, "Error: no interfaces to generate traffic for\n");
+        goto fail;
+    }
+    g->ifs = (struct sr_if**)malloc(g->nifs * sizeof(struct sr_if*));
+    assert(g->ifs);
+    for(i = 0, iface = sr->if_list; iface; iface = iface->next)
+    { g->ifs[i++] = iface; }
+
+    /* -- destinations: random hosts in random usable routes -- */
+    for(r = sr->routing_table; r; r = r->next)
+    {
+        if(sr_get_interface(sr, r->interface))
+        { nroutes++; }
+    }
+    if(nroutes == 0 &&
+       (g->weight[sr_gen_fwd] || g->weight[sr_gen_arprep] ||
+        g->weight[sr_gen_ttl] || g->weight[sr_gen_badsum]))
+    {
+        fprintf(stderr, "Error: no routes to generate traffic for\n");
+        goto fail;
+    }
+    if(nroutes == 0 || g->dests == 0)
+    { g->dests = 1; }
+
+    routes = (struct sr_rt**)malloc((nroutes + 1) * sizeof(struct sr_rt*));
+    assert(routes);
+    for(i = 0, r = sr->routing_table; r; r = r->next)
+    {
+        if(sr_get_interface(sr, r->interface))
+        { routes[i++] = r; }
+    }
+
+    g->dest = (struct sr_gen_dest*)calloc(g->dests, sizeof(struct sr_gen_dest));
+    g->cdf = (double*)malloc(g->dests * sizeof(double));
+    assert(g->dest && g->cdf);
+    for(i = 0; i < g->dests; i++)
+    {
+        if(nroutes == 0)
+        {
+            g->dest[i].ip = g->ifs[0]->ip;
+            g->dest[i].nh = g->ifs[0]->ip;
+            g->dest[i].out = g->ifs[0];
+        }
+        else
+        {
+            r = routes[sr_gen_rand(g) % nroutes];
+            g->dest[i].ip = sr_gen_host(g, r);
+            g->dest[i].nh = r->gw.s_addr ? r->gw.s_addr : g->dest[i].ip;
+            g->dest[i].out = sr_get_interface(sr, r->interface);
+        }
+
+        sum += g->zipf > 0 ? 1.0 / pow(i + 1, g->zipf) : 1.0;
+        g->cdf[i] = sum;
+    }
+    for(i = 0; i < g->dests; i++)
+    { g->cdf[i] /= sum; }
+
+    free(routes);
+    return g;
+
+fail:
+    free(routes);
+    sr_gen_destroy(g);
+    return 0;
+} /* -- sr_gen_create -- */
+
+void sr_gen_destroy(struct sr_gen* g)
+{
+    if(g == 0)
+    { return; }
+
+    free(g->dest);
+    free(g->cdf);
+    free(g->ifs);
+    free(g);
+} /* -- sr_gen_destroy -- */
+
+static struct sr_gen_dest* sr_gen_pick_dest(struct sr_gen* g)
+{
+    unsigned int lo = 0, hi = g->dests - 1, mid;
+    double u;
+
+    if(g->zipf <= 0)
+    { return &(g->dest[sr_gen_rand(g) % g->dests]); }
+
+    u = sr_gen_uniform(g);
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(g->cdf[mid] <= u)
+        { lo = mid + 1; }
+        else
+        { hi = mid; }
+    }
+    return &(g->dest[lo]);
+}
+
+static int sr_gen_pick_kind(struct sr_gen* g)
+{
+    unsigned int total = 0, x;
+    int k;
+
+    for(k = 0; k < sr_gen_kinds; k++)
+    { total += g->weight[k]; }
+    x = sr_gen_rand(g) % total;
+    for(k = 0; k < sr_gen_kinds - 1; k++)
+    {
+        if(x < g->weight[k])
+        { break; }
+        x -= g->weight[k];
+    }
+    return k;
+}
+
+/* a host behind iface: a destination routed out of it, or its neighbour */
+static uint32_t sr_gen_behind(struct sr_gen* g, struct sr_if* iface)
+{
+    struct sr_gen_dest* d;
+    int tries;
+
+    for(tries = 0; tries < 8; tries++)
+    {
+        d = &(g->dest[sr_gen_rand(g) % g->dests]);
+        if(d->out == iface && d->ip != iface->ip)
+        { return d->ip; }
+    }
+    return htonl(ntohl(iface->ip) ^ 1);
+}
+
+static void sr_gen_mac(uint8_t* mac, uint32_t ip)
+{
+    mac[0] = 0x02;
+    mac[1] = 0xbe;
+    memcpy(mac + 2, &ip, 4);
+}
+
+static void sr_gen_eth(uint8_t* buf, const uint8_t* dst, uint32_t src_ip,
+                       uint16_t type)
+{
+    sr_ethernet_hdr_t* ehdr = (sr_ethernet_hdr_t*)buf;
+
+    memcpy(ehdr->ether_dhost, dst, ETHER_ADDR_LEN);
+    sr_gen_mac(ehdr->ether_shost, src_ip);
+    ehdr->ether_type = htons(type);
+}
+
+/* IP header for len bytes of payload, payload zeroed */
+static sr_ip_hdr_t* sr_gen_ip(struct sr_gen* g, uint8_t* buf, uint32_t src,
+                              uint32_t dst, uint8_t proto, uint8_t ttl)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+
+    memset(ip, 0, sizeof(sr_ip_hdr_t) + g->len);
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + g->len);
+    ip->ip_id = htons(g->ip_id++);
+    ip->ip_off = htons(IP_DF);
+    ip->ip_ttl = ttl;
+    ip->ip_p = proto;
+    ip->ip_src = src;
+    ip->ip_dst = dst;
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+    return ip;
+}
+
+static unsigned int sr_gen_arp(uint8_t* buf, uint16_t op, const uint8_t* dst,
+                               uint32_t sip, const uint8_t* tha, uint32_t tip)
+{
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+
+    sr_gen_eth(buf, dst, sip, ethertype_arp);
+    memset(arp, 0, sizeof(sr_arp_hdr_t));
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(op);
+    sr_gen_mac(arp->ar_sha, sip);
+    arp->ar_sip = sip;
+    if(tha)
+    { memcpy(arp->ar_tha, tha, ETHER_ADDR_LEN); }
+    arp->ar_tip = tip;
+    return sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_gen_next(..)
+ * Scope:  Global
+ *
+ * Build the next frame in buf, which must hold SR_GEN_MAX_FRAME bytes,
+ * and point iface at the interface it arrives on.  Returns its length.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_gen_next(struct sr_gen* g, uint8_t* buf, const char** iface)
+{
+    static const uint8_t bcast[ETHER_ADDR_LEN] =
+    { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    struct sr_gen_dest* d;
+    struct sr_if* in;
+    sr_ip_hdr_t* ip;
+    sr_icmp_hdr_t* icmp;
+    uint8_t* l4;
+    uint32_t src;
+    unsigned int i;
+    int kind = sr_gen_pick_kind(g);
+
+    g->count[kind]++;
+    in = g->ifs[sr_gen_rand(g) % g->nifs];
+    *iface = in->name;
+
+    switch(kind)
+    {
+        case sr_gen_arpreq:
+            return sr_gen_arp(buf, arp_op_request, bcast,
+                              sr_gen_behind(g, in), 0, in->ip);
+
+        case sr_gen_arprep:
+            d = sr_gen_pick_dest(g);
+            *iface = d->out->name;
+            return sr_gen_arp(buf, arp_op_reply, d->out->addr, d->nh,
+                              d->out->addr, d->out->ip);
+
+        case sr_gen_echo:
+            src = sr_gen_behind(g, in);
+            sr_gen_eth(buf, in->addr, src, ethertype_ip);
+            ip = sr_gen_ip(g, buf, src, in->ip, ip_protocol_icmp, 64);
+            icmp = (sr_icmp_hdr_t*)(ip + 1);
+            icmp->icmp_type = 8;
+            l4 = (uint8_t*)(icmp + 1);
+            l4[0] = (g->ip_id >> 8) & 0xff;     /* identifier, sequence */
+            l4[1] = g->ip_id & 0xff;
+            for(i = SR_GEN_ECHO_LEN; i < g->len; i++)
+            { ((uint8_t*)icmp)[i] = i & 0xff; }
+            icmp->icmp_sum = cksum(icmp, g->len);
+            break;
+
+        default:
+            /* -- forwarded UDP, in on any interface but the way out -- */
+            d = sr_gen_pick_dest(g);
+            if(g->nifs > 1)
+            {
+                i = sr_gen_rand(g) % (g->nifs - 1);
+                in = g->ifs[i] == d->out ? g->ifs[g->nifs - 1] : g->ifs[i];
+                *iface = in->name;
+            }
+            src = sr_gen_behind(g, in);
+            sr_gen_eth(buf, in->addr, src, ethertype_ip);
+            ip = sr_gen_ip(g, buf, src, d->ip, ip_protocol_udp,
+                           kind == sr_gen_ttl ? 1 : 64);
+            l4 = (uint8_t*)(ip + 1);
+            l4[0] = 0x80 | (sr_gen_rand(g) & 0x7f);  /* source port */
+            l4[2] = 0x13;                            /* port 5001 */
+            l4[3] = 0x89;
+            l4[4] = (g->len >> 8) & 0xff;
+            l4[5] = g->len & 0xff;
+            if(kind == sr_gen_badsum)
+            { ip->ip_sum ^= htons(0x5a5a); }
+            break;
+    }
+
+    return sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + g->len;
+} /* -- sr_gen_next -- */
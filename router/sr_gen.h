@@ -0,0 +1,87 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_gen.h
+ *
+ * Description:
+ *
+ * Synthetic traffic for sr_bench.  Frames are built from the router's own
+ * interface list and routing table, using the header layouts in
+ * sr_protocol.h, in a mix given as a spec string such as
+ *
+ *     fwd=90,arpreq=2,arprep=2,echo=3,ttl=2,badsum=1,dests=1000,zipf=1.1
+ *
+ * Kinds of frame, by weight (fwd=100 if no weight is given):
+ *
+ *     fwd      UDP to one of the destinations, in on another interface
+ *     arpreq   broadcast ARP request for an interface IP
+ *     arprep   ARP reply from the next hop of one of the destinations
+ *     echo     ICMP echo request to an interface IP
+ *     ttl      as fwd, with a TTL of 1
+ *     badsum   as fwd, with a wrong IP header checksum
+ *
+ * Parameters:
+ *
+ *     dests    destinations, random hosts in random rtable prefixes (1000)
+ *     zipf     exponent of their popularity, 0 for uniform (0)
+ *     len      IP payload bytes of fwd/ttl/badsum/echo frames (64)
+ *     seed     for the random number generator (1)
+ *
+ * Values are whole numbers, but for zipf, and none may be negative.
+ * Weights go up to SR_GEN_MAX_WEIGHT and dests to SR_GEN_MAX_DESTS.
+ *
+ * Neighbours, whether hosts behind an interface or next hops, get the MAC
+ * 02:be followed by their IP.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_GEN_H
+#define sr_GEN_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_GEN_MAX_LEN 1500     /* largest IP datagram made */
+#define SR_GEN_MAX_WEIGHT 1000000
+#define SR_GEN_MAX_DESTS (1 << 22)
+#define SR_GEN_MAX_FRAME (SR_GEN_MAX_LEN + 14)
+
+enum sr_gen_kind
+{
+    sr_gen_fwd = 0,
+    sr_gen_arpreq,
+    sr_gen_arprep,
+    sr_gen_echo,
+    sr_gen_ttl,
+    sr_gen_badsum,
+    sr_gen_kinds
+};
+
+struct sr_instance;
+struct sr_gen_dest;
+
+struct sr_gen
+{
+    struct sr_instance* sr;
+    unsigned int weight[sr_gen_kinds];
+    unsigned long count[sr_gen_kinds];  /* frames made of each kind */
+    unsigned int dests;
+    double zipf;
+    unsigned int len;
+    uint64_t rng;
+    struct sr_gen_dest* dest;
+    double* cdf;                /* dest popularity, cumulative */
+    struct sr_if** ifs;         /* interface list as an array */
+    unsigned int nifs;
+    uint16_t ip_id;
+};
+
+struct sr_gen* sr_gen_create(struct sr_instance* sr, const char* spec);
+void sr_gen_destroy(struct sr_gen* );
+unsigned int sr_gen_next(struct sr_gen* , uint8_t* buf, const char** iface);
+const char* sr_gen_kind_name(int kind);
+
+#endif  /* --  sr_GEN_H -- */
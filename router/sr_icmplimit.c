@@ -0,0 +1,259 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplimit.c
+ *
+ * Description:
+ *
+ * ICMP error rate limits, see sr_icmplimit.h.  A bucket that refills at
+ * one token per interval and holds burst tokens is full again at its
+ * theoretical arrival time tat; taking a token pushes tat one interval
+ * further out, which is allowed while it stays within burst intervals of
+ * now.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "sr_icmplimit.h"
+#include "sr_if.h"
+
+static const char* sr_icmplimit_names[sr_icmplimit_scopes] =
+{ "src", "if", "all" };
+
+static uint64_t sr_icmplimit_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* take a token from the bucket kept in *tat; 0 if it is empty */
+static int sr_icmplimit_take(uint64_t* tat, const struct sr_icmplimit_rate* r,
+                             uint64_t now)
+{
+    uint64_t old, next, interval;
+
+    if(r->rate == 0)
+    { return 1; }
+
+    interval = (uint64_t)1000000000 / r->rate;
+    old = __atomic_load_n(tat, __ATOMIC_RELAXED);
+    do
+    {
+        next = (old > now ? old : now) + interval;
+        if(next - now > (uint64_t)r->burst * interval)
+        { return 0; }
+    } while(!__atomic_compare_exchange_n(tat, &old, next, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 1;
+}
+
+/* put back a token taken by sr_icmplimit_take when a later bucket refused;
+   a bucket that was full is left full as of when it was taken */
+static void sr_icmplimit_give(uint64_t* tat, const struct sr_icmplimit_rate* r)
+{
+    if(r->rate == 0)
+    { return; }
+    __atomic_sub_fetch(tat, (uint64_t)1000000000 / r->rate, __ATOMIC_RELAXED);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplimit_create(..)
+ * Scope:  Global
+ *
+ * Returns limits with the defaults in place, or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_icmplimit* sr_icmplimit_create(void)
+{
+    struct sr_icmplimit* l;
+
+    l = (struct sr_icmplimit*)calloc(1, sizeof(struct sr_icmplimit));
+    if(l == 0)
+    { return 0; }
+
+    l->src = (uint64_t*)calloc(SR_ICMPLIMIT_PREFIXES, sizeof(uint64_t));
+    if(l->src == 0)
+    {
+        free(l);
+        return 0;
+    }
+    l->limit[sr_icmplimit_all].rate = SR_ICMPLIMIT_RATE;
+    l->limit[sr_icmplimit_all].burst = SR_ICMPLIMIT_BURST;
+    l->len = SR_ICMPLIMIT_LEN;
+    return l;
+} /* -- sr_icmplimit_create -- */
+
+void sr_icmplimit_destroy(struct sr_icmplimit* l)
+{
+    if(l == 0)
+    { return; }
+    free(l->src);
+    free(l);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplimit_parse(..)
+ * Scope:  Global
+ *
+ * Apply a spec string as described in sr_icmplimit.h.  Only the limits
+ * it names change.  Returns -1 if it could not be parsed.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmplimit_parse(struct sr_icmplimit* l, const char* spec)
+{
+    char* copy;
+    char* tok;
+    char* save = 0;
+    char* val;
+    char* end;
+    unsigned long rate, burst;
+    int i, ret = 0;
+
+    if(strcmp(spec, "off") == 0)
+    {
+        for(i = 0; i < sr_icmplimit_scopes; i++)
+        { l->limit[i].rate = 0; }
+        return 0;
+    }
+
+    if((copy = strdup(spec)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_icmplimit_parse)\n");
+        return -1;
+    }
+    for(tok = strtok_r(copy, ",", &save); tok && ret == 0;
+        tok = strtok_r(0, ",", &save))
+    {
+        if((val = strchr(tok, '=')) == 0)
+        {
+            ret = -1;
+            break;
+        }
+        *val++ = '\0';
+
+        if(strcmp(tok, "len") == 0)
+        {
+            rate = strtoul(val, &end, 10);
+            if(*end || end == val || rate > 32)
+            { ret = -1; }
+            else
+            { l->len = rate; }
+            continue;
+        }
+
+        for(i = 0; i < sr_icmplimit_scopes; i++)
+        {
+            if(strcmp(tok, sr_icmplimit_names[i]) == 0)
+            { break; }
+        }
+        rate = strtoul(val, &end, 10);
+        burst = rate;
+        if(end != val && *end == '/')
+        {
+            val = end + 1;
+            burst = strtoul(val, &end, 10);
+        }
+        if(i == sr_icmplimit_scopes || *end || end == val ||
+           rate > SR_ICMPLIMIT_MAX_RATE || burst > UINT_MAX)
+        {
+            ret = -1;
+            break;
+        }
+        l->limit[i].rate = rate;
+        l->limit[i].burst = burst ? burst : 1;
+    }
+
+    if(ret != 0)
+    { fprintf(stderr, "Error: bad ICMP limit in %s\n", spec); }
+    free(copy);
+    return ret;
+} /* -- sr_icmplimit_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplimit_allow(..)
+ * Scope:  Global
+ *
+ * Whether an ICMP error of type/code about a packet from src (network
+ * byte order) may go out of iface, and count it either way.  iface may
+ * be 0 if it is not known.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmplimit_allow(struct sr_icmplimit* l, struct sr_if* iface,
+                       uint32_t src, uint8_t type, uint8_t code)
+{
+    uint64_t now = sr_icmplimit_now();
+    uint32_t key;
+    unsigned int t = type % SR_ICMPLIMIT_TYPES;
+    unsigned int c = code % SR_ICMPLIMIT_CODES;
+    uint64_t* tat[sr_icmplimit_scopes];
+    int i, by = -1;
+
+    key = l->len ? ntohl(src) & (0xffffffffU << (32 - l->len)) : 0;
+    key = (key * 2654435761U) >> 16;
+    tat[sr_icmplimit_src] = &(l->src[key & (SR_ICMPLIMIT_PREFIXES - 1)]);
+    tat[sr_icmplimit_if] = iface ? &(iface->icmp_tat) : 0;
+    tat[sr_icmplimit_all] = &(l->all);
+
+    /* -- all or nothing: a bucket that refuses gives back what the
+          ones before it took -- */
+    for(i = 0; i < sr_icmplimit_scopes && by < 0; i++)
+    {
+        if(tat[i] && !sr_icmplimit_take(tat[i], &(l->limit[i]), now))
+        { by = i; }
+    }
+    for(i = 0; i < by; i++)
+    {
+        if(tat[i])
+        { sr_icmplimit_give(tat[i], &(l->limit[i])); }
+    }
+
+    if(by >= 0)
+    {
+        __atomic_add_fetch(&(l->suppressed[t][c]), 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(l->by[by]), 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_add_fetch(&(l->sent[t][c]), 1, __ATOMIC_RELAXED);
+    return 1;
+} /* -- sr_icmplimit_allow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplimit_print(..)
+ * Scope:  Global
+ *
+ * Errors sent and suppressed by type and code, and which bucket
+ * suppressed them.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmplimit_print(struct sr_icmplimit* l, FILE* fp)
+{
+    unsigned int t, c;
+    int i;
+
+    if(l == 0)
+    { return; }
+
+    for(t = 0; t < SR_ICMPLIMIT_TYPES; t++)
+    {
+        for(c = 0; c < SR_ICMPLIMIT_CODES; c++)
+        {
+            if(l->sent[t][c] == 0 && l->suppressed[t][c] == 0)
+            { continue; }
+            fprintf(fp, "icmp type %u code %u: %lu sent, %lu suppressed\n",
+                    t, c, l->sent[t][c], l->suppressed[t][c]);
+        }
+    }
+    fprintf(fp, "icmp suppressed by:");
+    for(i = 0; i < sr_icmplimit_scopes; i++)
+    { fprintf(fp, " %s %lu", sr_icmplimit_names[i], l->by[i]); }
+    fprintf(fp, "\n");
+} /* -- sr_icmplimit_print -- */
@@ -0,0 +1,90 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplimit.h
+ *
+ * Description:
+ *
+ * Rate limits for the ICMP errors sr_send_icmp3(..) generates, so a
+ * traceroute storm or a scan cannot keep the router busy building them.
+ * An error must get past up to three token buckets, most specific first:
+ *
+ *     src      one per source prefix of the offending packet
+ *     if       one per interface the error goes out of
+ *     all      one for the router
+ *
+ * and is dropped, before anything is built, by the first that is empty;
+ * the buckets before it get their tokens back.
+ * Each bucket refills at rate tokens per second and holds at most burst.
+ * The per-prefix buckets are a fixed hashed table; prefixes that hash
+ * alike share a bucket, which errs on the side of limiting.
+ *
+ * A bucket is kept as the time it would next be full (the "theoretical
+ * arrival time"), so taking a token is one compare-and-swap and the
+ * forwarding threads never lock.
+ *
+ * Limits are given as a spec string such as
+ *
+ *     all=1000/50,if=200/20,src=10/5,len=24
+ *
+ * rate/burst for each bucket (the burst defaults to the rate, a rate of 0
+ * means no limit, the most is SR_ICMPLIMIT_MAX_RATE), and len the source
+ * prefix length.  "off" removes every
+ * limit.  By default only all=1000/50 applies.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_ICMPLIMIT_H
+#define sr_ICMPLIMIT_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_ICMPLIMIT_RATE     1000  /* default errors per second, all */
+#define SR_ICMPLIMIT_BURST    50
+#define SR_ICMPLIMIT_MAX_RATE 1000000000  /* one a nanosecond, the clock's unit */
+#define SR_ICMPLIMIT_LEN      24    /* default source prefix length */
+#define SR_ICMPLIMIT_PREFIXES 4096  /* per-prefix buckets, a power of two */
+#define SR_ICMPLIMIT_TYPES    32    /* counters kept for types below this */
+#define SR_ICMPLIMIT_CODES    16    /* and codes below this */
+
+enum sr_icmplimit_scope
+{
+    sr_icmplimit_src = 0,
+    sr_icmplimit_if,
+    sr_icmplimit_all,
+    sr_icmplimit_scopes
+};
+
+struct sr_icmplimit_rate
+{
+    unsigned int rate;          /* tokens per second, 0: no limit */
+    unsigned int burst;         /* tokens the bucket holds */
+};
+
+struct sr_if;
+
+struct sr_icmplimit
+{
+    struct sr_icmplimit_rate limit[sr_icmplimit_scopes];
+    unsigned int len;           /* source prefix length */
+    uint64_t all;               /* the router's bucket */
+    uint64_t* src;              /* SR_ICMPLIMIT_PREFIXES buckets */
+    unsigned long sent[SR_ICMPLIMIT_TYPES][SR_ICMPLIMIT_CODES];
+    unsigned long suppressed[SR_ICMPLIMIT_TYPES][SR_ICMPLIMIT_CODES];
+    unsigned long by[sr_icmplimit_scopes];  /* suppressed by each bucket */
+};
+
+struct sr_icmplimit* sr_icmplimit_create(void);
+void sr_icmplimit_destroy(struct sr_icmplimit* );
+int sr_icmplimit_parse(struct sr_icmplimit* , const char* spec);
+int sr_icmplimit_allow(struct sr_icmplimit* , struct sr_if* iface,
+                       uint32_t src, uint8_t type, uint8_t code);
+void sr_icmplimit_print(struct sr_icmplimit* , FILE* fp);
+
+#endif  /* --  sr_ICMPLIMIT_H -- */
@@ -21,9 +21,58 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <net/if.h>
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_utils.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_build_tmpl(..)
+ * Scope: Local
+ *
+ * (Re)build the frames in iface->tmpl from its current addresses
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_if_build_tmpl(struct sr_if* iface)
+{
+    struct sr_if_tmpl* t = &(iface->tmpl);
+    sr_ethernet_hdr_t* ehdr;
+    sr_arp_hdr_t* arp;
+    sr_ip_hdr_t* ip;
+
+    memset(t, 0, sizeof(struct sr_if_tmpl));
+
+    /* -- ARP request and reply -- */
+    ehdr = (sr_ethernet_hdr_t*)t->arp_req;
+    arp = (sr_arp_hdr_t*)(t->arp_req + sizeof(sr_ethernet_hdr_t));
+    memcpy(ehdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    ehdr->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    memcpy(arp->ar_sha, iface->addr, ETHER_ADDR_LEN);
+    arp->ar_sip = iface->ip;
+    memcpy(t->arp_rep, t->arp_req, SR_ARP_FRAME_LEN);
+    memset(ehdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    arp->ar_op = htons(arp_op_request);
+    arp = (sr_arp_hdr_t*)(t->arp_rep + sizeof(sr_ethernet_hdr_t));
+    arp->ar_op = htons(arp_op_reply);
+
+    /* -- ICMP error, the IP sum over everything but the addresses -- */
+    ehdr = (sr_ethernet_hdr_t*)t->icmp3;
+    ip = (sr_ip_hdr_t*)(t->icmp3 + sizeof(sr_ethernet_hdr_t));
+    memcpy(ehdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    ehdr->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t));
+    ip->ip_ttl = INIT_TTL;
+    ip->ip_p = ip_protocol_icmp;
+    t->icmp3_ip_sum = cksum_sum(ip, sizeof(sr_ip_hdr_t));
+} /* -- sr_if_build_tmpl -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
@@ -76,6 +125,7 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
+        sr->if_list->icmp_tat = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
         return;
     }
@@ -89,6 +139,7 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     assert(if_walker->next);
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+    if_walker->icmp_tat = 0;
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
@@ -113,6 +164,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
 
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
+    sr_if_build_tmpl(if_walker);
 
 } /* -- sr_set_ether_addr -- */
 
@@ -137,6 +189,7 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
+    sr_if_build_tmpl(if_walker);
 
 } /* -- sr_set_ether_ip -- */
 
@@ -192,3 +245,59 @@ void sr_print_if(struct sr_if* iface)
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
 } /* -- sr_print_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ifmap_parse(..)
+ * Scope:  Global
+ *
+ * Pull "name[=dev][@ip]" off the front of *map.  Returns 0 at the end,
+ * -1 if the entry is malformed.  *ip is 0 unless one was given.  name
+ * and dev must hold sr_IFACE_NAMELEN bytes; nothing longer is copied.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ifmap_parse(const char** map, char* name, char* dev, uint32_t* ip)
+{
+    const char* p = *map;
+    const char* end;
+    char tok[3 * sr_IFACE_NAMELEN];
+    char* at;
+    char* eq;
+    const char* dname;
+    size_t len, dlen;
+    struct in_addr addr;
+
+    if(*p == 0)
+    { return 0; }
+
+    end = strchr(p, ',');
+    len = end ? (size_t)(end - p) : strlen(p);
+    *map = end ? end + 1 : p + len;
+    if(len == 0 || len >= sizeof(tok))
+    { return -1; }
+    memcpy(tok, p, len);
+    tok[len] = 0;
+
+    *ip = 0;
+    if((at = strchr(tok, '@')) != 0)
+    {
+        *at = 0;
+        if(inet_aton(at + 1, &addr) == 0)
+        { return -1; }
+        *ip = addr.s_addr;
+    }
+    if((eq = strchr(tok, '=')) != 0)
+    { *eq = 0; }
+
+    /* -- both must fit before either is copied out -- */
+    dname = eq ? eq + 1 : tok;
+    len = strlen(tok);
+    dlen = strlen(dname);
+    if(len == 0 || len >= sr_IFACE_NAMELEN)
+    { return -1; }
+    if(dlen == 0 || dlen >= IFNAMSIZ || dlen >= sr_IFACE_NAMELEN)
+    { return -1; }
+    memcpy(name, tok, len + 1);
+    memcpy(dev, dname, dlen + 1);
+    return 1;
+} /* -- sr_ifmap_parse -- */
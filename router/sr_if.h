@@ -28,6 +28,29 @@
 
 struct sr_instance;
 
+#define SR_ARP_FRAME_LEN   (sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+#define SR_ICMP3_FRAME_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                            sizeof(sr_icmp_t3_hdr_t))
+
+/* ----------------------------------------------------------------------------
+ * struct sr_if_tmpl
+ *
+ * Frames the router sends from an interface, built whenever its addresses
+ * are set so that sending one is a copy and a few patched fields.  Only
+ * what depends on the receiver, and in the ICMP error on the packet it is
+ * about, is left blank.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_if_tmpl
+{
+  uint8_t arp_req[SR_ARP_FRAME_LEN];    /* broadcast, target IP blank */
+  uint8_t arp_rep[SR_ARP_FRAME_LEN];    /* receiver blank */
+  uint8_t icmp3[SR_ICMP3_FRAME_LEN];    /* destination MAC, IP addresses,
+                                           ICMP type/code, data blank */
+  uint32_t icmp3_ip_sum;                /* cksum_sum() of its IP header */
+};
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
@@ -41,6 +64,8 @@ struct sr_if
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  uint64_t icmp_tat;            /* ICMP error bucket, see sr_icmplimit.h */
+  struct sr_if_tmpl tmpl;
   struct sr_if* next;
 };
 
@@ -50,5 +75,6 @@ void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
+int sr_ifmap_parse(const char** map, char* name, char* dev, uint32_t* ip);
 
 #endif /* --  sr_INTERFACE_H -- */
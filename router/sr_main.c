@@ -32,6 +32,12 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_pool.h"
+#include "sr_workers.h"
+#include "sr_afpacket.h"
+#include "sr_xsk.h"
+#include "sr_capture.h"
+#include "sr_icmplimit.h"
 
 extern char* optarg;
 
@@ -65,11 +71,25 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    int capture_policy = sr_capture_drop;
+    int fib_engine = fib_engine_trie;
+    unsigned int arp_max = 0;
+    unsigned int arp_retry = 0;
+    unsigned int arp_timeout = 0;
+    unsigned int arpq_depth = 0;
+    int arpq_policy = -1;
+    unsigned long arpq_bytes = 0;
+    char *icmp_limits = 0;
+    int event_loop = 0;
+    unsigned int workers = 0;
+    char *ifmap = 0;
+    int xdp = 0;
+    unsigned long tx_frames, tx_writes;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:F:a:ER:A:w:P:X:L:q:Q:m:e:")) != EOF)
     {
         switch (c)
         {
@@ -101,14 +121,88 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'F':
+                if(strcmp(optarg, "trie") == 0)
+                { fib_engine = fib_engine_trie; }
+                else if(strcmp(optarg, "dir248") == 0)
+                { fib_engine = fib_engine_dir248; }
+                else if(strcmp(optarg, "sorted") == 0)
+                { fib_engine = fib_engine_sorted; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'a':
+                arp_max = atoi((char *) optarg);
+                break;
+            case 'E':
+                event_loop = 1;
+                break;
+            case 'R':
+                arp_retry = atoi((char *) optarg);
+                break;
+            case 'A':
+                arp_timeout = atoi((char *) optarg);
+                break;
+            case 'w':
+                workers = atoi((char *) optarg);
+                break;
+            case 'P':
+                ifmap = optarg;
+                xdp = 0;
+                break;
+            case 'X':
+                ifmap = optarg;
+                xdp = 1;
+                break;
+            case 'L':
+                if(strcmp(optarg, "drop") == 0)
+                { capture_policy = sr_capture_drop; }
+                else if(strcmp(optarg, "block") == 0)
+                { capture_policy = sr_capture_block; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'q':
+                arpq_depth = atoi((char *) optarg);
+                break;
+            case 'Q':
+                if(strcmp(optarg, "oldest") == 0)
+                { arpq_policy = sr_arpq_drop_oldest; }
+                else if(strcmp(optarg, "newest") == 0)
+                { arpq_policy = sr_arpq_drop_newest; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'm':
+                arpq_bytes = strtoul((char *) optarg, 0, 10);
+                break;
+            case 'e':
+                icmp_limits = optarg;
+                break;
         } /* switch */
     } /* -- while -- */
 
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    if(icmp_limits && sr_icmplimit_parse(sr.icmplimit, icmp_limits) != 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+    sr.fib_engine = fib_engine;
+    sr.event_loop = event_loop;
 
     /* -- set up routing table from file -- */
-    if(template == NULL) {
+    if(template == NULL || ifmap != 0) {
         sr.template[0] = '\0';
         sr_load_rt_wrap(&sr, rtable);
     }
@@ -133,34 +227,93 @@ int main(int argc, char **argv)
                     logfile);
             exit(1);
         }
+        sr.capture = sr_capture_start(sr.logfile, capture_policy);
     }
 
-    Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
-    if(template)
-        Debug("Requesting topology template %s\n", template);
-    else
-        Debug("Requesting topology %d\n", topo);
-
-    /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    if(ifmap != 0)
     {
-        return 1;
+        /* -- no server, the interfaces are the host's own -- */
+        if(xdp)
+        {
+            if((sr.xsk = sr_xsk_open(&sr, ifmap)) == 0)
+            { return 1; }
+        }
+        else if((sr.afp = sr_afpacket_open(&sr, ifmap)) == 0)
+        { return 1; }
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with hardware\n");
+            return 1;
+        }
     }
+    else
+    {
+        Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
+        if(template)
+            Debug("Requesting topology template %s\n", template);
+        else
+            Debug("Requesting topology %d\n", topo);
+
+        /* connect to server and negotiate session */
+        if(sr_connect_to_server(&sr,port,server) == -1)
+        {
+            return 1;
+        }
 
-    if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
-        Debug("Connected to new instantiation of topology template %s\n", template);
-        sr_load_rt_wrap(&sr, "rtable.vrhost");
-    }
-    else {
-      /* Read from specified routing table */
-      sr_load_rt_wrap(&sr, rtable);
+        if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
+            Debug("Connected to new instantiation of topology template %s\n", template);
+            sr_load_rt_wrap(&sr, "rtable.vrhost");
+        }
+        else {
+          /* Read from specified routing table */
+          sr_load_rt_wrap(&sr, rtable);
+        }
     }
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
+    if(arp_max)
+    { sr_arpcache_set_max(&(sr.cache), arp_max); }
+    sr_arpcache_set_timers(&(sr.cache), arp_retry, arp_timeout);
+    if(sr_arpcache_set_queue(&(sr.cache), arpq_depth, arpq_policy, arpq_bytes) != 0)
+    {
+        fprintf(stderr, "Error: at most %d packets may be queued per hop\n",
+                SR_ARPREQ_QMAX);
+        usage(argv[0]);
+        exit(1);
+    }
+    if(workers)
+    {
+        if((sr.workers = sr_workers_start(&sr, workers)) == 0)
+        { return 1; }
+    }
 
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    if(sr.afp)
+    { sr_afpacket_loop(&sr); }
+    else if(sr.xsk)
+    { sr_xsk_loop(&sr); }
+    else if(sr.event_loop)
+    { sr_event_loop(&sr); }
+    else
+    { while( sr_read_from_server(&sr) == 1); }
+
+    sr_workers_stop(sr.workers);
+    sr.workers = 0;
+    sr_afpacket_close(sr.afp);
+    sr.afp = 0;
+    sr_xsk_close(sr.xsk);
+    sr.xsk = 0;
+    sr_capture_stop(sr.capture);
+    sr.capture = 0;
+    sr_icmplimit_print(sr.icmplimit, stderr);
+    sr_tx_counters(&sr, &tx_frames, &tx_writes);
+    if(tx_writes)
+    {
+        fprintf(stderr, "vns tx: %lu frames in %lu writes, %.1f frames per flush, "
+                "%lu syscalls saved\n", tx_frames, tx_writes,
+                (double)tx_frames / tx_writes, tx_frames - tx_writes);
+    }
 
     sr_destroy_instance(&sr);
 
@@ -178,7 +331,17 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-L drop|block when logging falls behind] \n");
+    printf("           [-F trie|dir248|sorted] [-a max arp entries] \n");
+    printf("           [-E] [-R arp retry ms] [-A arp timeout ms] \n");
+    printf("           [-q packets queued per unresolved hop] \n");
+    printf("           [-Q oldest|newest dropped when full] [-m max queued bytes] \n");
+    printf("           [-w forwarding threads] \n");
+    printf("           [-e all=rate/burst,if=rate/burst,src=rate/burst,len=bits|off\n");
+    printf("               ICMP error limits, default all=%d/%d] \n",
+            SR_ICMPLIMIT_RATE, SR_ICMPLIMIT_BURST);
+    printf("           [-P name[=dev][@ip],... use host interfaces, no server] \n");
+    printf("           [-X name[=dev][@ip],... the same through AF_XDP] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -248,7 +411,28 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
+    sr->rt_tail = 0;
+    sr->rt_trie = 0;
+    sr->fib_engine = fib_engine_trie;
+    sr->rt_dir248 = 0;
+    sr->rt_array = 0;
+    sr->rt_array_len = 0;
+    sr->rt_array_cap = 0;
+    sr->rt_array_dirty = 0;
+    sr->nexthops = 0;
+    sr->nexthops_len = 0;
+    sr->nexthops_cap = 0;
+    sr->nh_hash = 0;
+    sr->pool = sr_pool_create(SR_POOL_BUF_SZ, SR_POOL_BUFS);
+    sr->txq = 0;
+    sr->rxb = 0;
+    sr->event_loop = 0;
+    sr->workers = 0;
+    sr->afp = 0;
+    sr->xsk = 0;
     sr->logfile = 0;
+    sr->capture = 0;
+    sr->icmplimit = sr_icmplimit_create();
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -0,0 +1,1371 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_micro.c
+ *
+ * Description:
+ *
+ * The tests behind sr_bench -t, see sr_micro.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "sr_micro.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_arpcache.h"
+#include "sr_workers.h"
+#include "sr_pool.h"
+#include "sr_utils.h"
+#include "sr_trie.h"
+#include "sr_dir248.h"
+#include "sr_timer.h"
+#include "sr_icmplimit.h"
+#include "sr_gen.h"
+#include "sr_vns_rx.h"
+#include "vnscommand.h"
+
+void (*sr_micro_tx)(const uint8_t* buf, unsigned int len);
+
+struct sr_micro_test
+{
+    const char* name;
+    int check;                  /* 1: a check, 0: a benchmark */
+    int (*run)(void);           /* 0 if it passed */
+    const char* what;
+};
+
+static uint32_t micro_seed = 1;
+
+/* xorshift32, so runs are repeatable */
+static uint32_t sr_micro_rand(void)
+{
+    micro_seed ^= micro_seed << 13;
+    micro_seed ^= micro_seed >> 17;
+    micro_seed ^= micro_seed << 5;
+    return micro_seed;
+}
+
+static double sr_micro_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the router logs every packet to stdout; keep that out of the report */
+static int sr_micro_mute(void)
+{
+    int out, null;
+
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    if((null = open("/dev/null", O_WRONLY)) >= 0)
+    {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return out;
+}
+
+static void sr_micro_unmute(int out)
+{
+    fflush(stdout);
+    if(out >= 0)
+    {
+        dup2(out, STDOUT_FILENO);
+        close(out);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_ifmap(..)
+ * Scope:  Local
+ *
+ * Interface map entries, good and bad.  The names are parsed into
+ * buffers of exactly sr_IFACE_NAMELEN bytes with a guard behind them
+ * that must come through untouched.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_ifmap(void)
+{
+    static const struct
+    {
+        const char* map;
+        int ret;                /* of the first entry */
+        const char* dev;
+    } cases[] =
+    {
+        { "eth1=va@10.0.1.1",   1, "va" },
+        { "eth1",               1, "eth1" },
+        { "eth1=vb,eth2=vc",    1, "vb" },
+        { "eth1=",             -1, 0 },
+        { "=va",               -1, 0 },
+        { "eth1=va@10.0.1",     1, "va" },
+        { "eth1=va@ten",       -1, 0 },
+        { "eth1=abcdefghijklmno", 1, "abcdefghijklmno" },
+        { "eth1=abcdefghijklmnop", -1, 0 },
+        { "eth1=aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+          -1, 0 },
+        { "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa=va", -1, 0 },
+        { "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+          -1, 0 },
+        { "",                   0, 0 }
+    };
+    struct
+    {
+        char buf[sr_IFACE_NAMELEN];
+        char guard[sr_IFACE_NAMELEN];
+    } name, dev;
+    char clean[sr_IFACE_NAMELEN];
+    const char* p;
+    uint32_t ip;
+    unsigned int i;
+    int ret, bad = 0;
+
+    memset(clean, 0x5a, sizeof(clean));
+    for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        memset(&name, 0x5a, sizeof(name));
+        memset(&dev, 0x5a, sizeof(dev));
+        p = cases[i].map;
+        ret = sr_ifmap_parse(&p, name.buf, dev.buf, &ip);
+        if(memcmp(name.guard, clean, sizeof(clean)) != 0 ||
+           memcmp(dev.guard, clean, sizeof(clean)) != 0)
+        {
+            printf("ifmap: \"%s\" wrote past the name buffers\n", cases[i].map);
+            bad++;
+        }
+        else if(ret != cases[i].ret ||
+                (ret > 0 && strcmp(dev.buf, cases[i].dev) != 0))
+        {
+            printf("ifmap: \"%s\" gave %d, expected %d\n", cases[i].map, ret,
+                   cases[i].ret);
+            bad++;
+        }
+    }
+    printf("ifmap: %u maps, %d wrong\n", i, bad);
+    return bad ? -1 : 0;
+} /* -- sr_micro_ifmap -- */
+
+#define SR_MICRO_FLOWS  64
+#define SR_MICRO_HOPS   4
+
+static int micro_last[SR_MICRO_FLOWS];
+static unsigned long micro_sent;
+static unsigned long micro_reordered;
+
+/* what the writer sends: UDP frames carry their flow in the source port
+   and a sequence number as payload */
+static void sr_micro_order_tx(const uint8_t* buf, unsigned int len)
+{
+    const sr_ip_hdr_t* ip = (const sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    const uint8_t* udp = (const uint8_t*)(ip + 1);
+    uint16_t port;
+    int f, seq;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 12 ||
+       ethertype((uint8_t*)buf) != ethertype_ip || ip->ip_p != ip_protocol_udp)
+    { return; }
+    memcpy(&port, udp, 2);
+    memcpy(&seq, udp + 8, 4);
+    f = (ntohs(port) - 1000) % SR_MICRO_FLOWS;
+    if(seq <= micro_last[f])
+    { micro_reordered++; }
+    micro_last[f] = seq;
+    micro_sent++;
+}
+
+/* UDP from host f behind in to a host on the other side */
+static unsigned int sr_micro_udp(uint8_t* buf, struct sr_if* in, int f,
+                                 uint32_t dst, int seq)
+{
+    sr_ethernet_hdr_t* ehdr = (sr_ethernet_hdr_t*)buf;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    uint8_t* udp = (uint8_t*)(ip + 1);
+    uint16_t port;
+
+    memset(buf, 0, sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 12);
+    memcpy(ehdr->ether_dhost, in->addr, ETHER_ADDR_LEN);
+    ehdr->ether_shost[0] = 0x02;
+    ehdr->ether_shost[5] = f;
+    ehdr->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + 12);
+    ip->ip_ttl = 64;
+    ip->ip_p = ip_protocol_udp;
+    ip->ip_src = htonl(0x0a010000 + 2 + f);
+    ip->ip_dst = dst;
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+    port = htons(1000 + f);
+    memcpy(udp, &port, 2);
+    memcpy(udp + 2, &port, 2);
+    memcpy(udp + 8, &seq, 4);
+    return sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 12;
+}
+
+/* an ARP reply from ip to out */
+static unsigned int sr_micro_arp_reply(uint8_t* buf, struct sr_if* out,
+                                       uint32_t ip)
+{
+    sr_ethernet_hdr_t* ehdr = (sr_ethernet_hdr_t*)buf;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+
+    memset(buf, 0, SR_ARP_FRAME_LEN);
+    memcpy(ehdr->ether_dhost, out->addr, ETHER_ADDR_LEN);
+    ehdr->ether_shost[0] = 0x02;
+    ehdr->ether_shost[1] = 0xbe;
+    memcpy(ehdr->ether_shost + 2, &ip, 4);
+    ehdr->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(arp_op_reply);
+    memcpy(arp->ar_sha, ehdr->ether_shost, ETHER_ADDR_LEN);
+    arp->ar_sip = ip;
+    memcpy(arp->ar_tha, out->addr, ETHER_ADDR_LEN);
+    arp->ar_tip = out->ip;
+    return SR_ARP_FRAME_LEN;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_order(..)
+ * Scope:  Local
+ *
+ * Per-flow order through the workers across ARP resolution.  Flows to a
+ * few unresolved next hops are dispatched to four workers, the next hops
+ * answer part way through, and the flows go on.  Every frame must come
+ * out of the writer, each flow's in the order it went in, and every pool
+ * buffer must be back.  New next hops each round, so every round
+ * resolves afresh.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_order(void)
+{
+    static const unsigned char mac1[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+    static const unsigned char mac2[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 2 };
+    struct sr_instance sr;
+    struct in_addr dest, gw, mask;
+    struct sr_if* in;
+    struct sr_if* out;
+    uint8_t buf[128];
+    unsigned long expected = 0;
+    unsigned int len;
+    int round, k, f, h, quiet;
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.event_loop = 1;
+    sr.pool = sr_pool_create(SR_POOL_BUF_SZ, SR_POOL_BUFS);
+    sr_add_interface(&sr, "eth1");
+    sr_set_ether_addr(&sr, mac1);
+    sr_set_ether_ip(&sr, htonl(0x0a010001));
+    sr_add_interface(&sr, "eth2");
+    sr_set_ether_addr(&sr, mac2);
+    sr_set_ether_ip(&sr, htonl(0x0a020001));
+    dest.s_addr = htonl(0x0a010000);
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xffff0000);
+    sr_add_rt_entry(&sr, dest, gw, mask, "eth1");
+    dest.s_addr = htonl(0x0a020000);
+    sr_add_rt_entry(&sr, dest, gw, mask, "eth2");
+    sr_init(&sr);
+    sr_arpcache_set_queue(&(sr.cache), 4096, -1, 1UL << 26);
+    in = sr_get_interface(&sr, "eth1");
+    out = sr_get_interface(&sr, "eth2");
+
+    for(f = 0; f < SR_MICRO_FLOWS; f++)
+    { micro_last[f] = -1; }
+    micro_sent = micro_reordered = 0;
+    sr_micro_tx = sr_micro_order_tx;
+
+    quiet = sr_micro_mute();
+    for(round = 0; round < 50; round++)
+    {
+        if((sr.workers = sr_workers_start(&sr, 4)) == 0)
+        { break; }
+        for(k = 0; k < 60; k++)
+        {
+            for(f = 0; f < SR_MICRO_FLOWS; f++)
+            {
+                len = sr_micro_udp(buf, in, f, htonl(0x0a020000 +
+                          (round + 1) * 256 + 2 + f % SR_MICRO_HOPS),
+                          round * 100 + k);
+                sr_workers_dispatch(sr.workers, buf, len, in->name);
+                expected++;
+            }
+            if(k == 20)
+            {
+                for(h = 0; h < SR_MICRO_HOPS; h++)
+                {
+                    len = sr_micro_arp_reply(buf, out, htonl(0x0a020000 +
+                              (round + 1) * 256 + 2 + h));
+                    sr_workers_dispatch(sr.workers, buf, len, out->name);
+                }
+            }
+            if(k % 7 == 0)
+            { sched_yield(); }
+        }
+        sr_workers_stop(sr.workers);
+        sr.workers = 0;
+    }
+    sr_micro_tx = 0;
+    sr_micro_unmute(quiet);
+
+    printf("order: %lu frames of %d flows, %lu sent, %lu out of order, "
+           "%lu pool buffers left in use\n", expected, SR_MICRO_FLOWS,
+           micro_sent, micro_reordered, sr_pool_in_use(sr.pool));
+    return (micro_sent == expected && micro_reordered == 0 &&
+            sr_pool_in_use(sr.pool) == 0) ? 0 : -1;
+} /* -- sr_micro_order -- */
+
+#define SR_MICRO_LOOKUPS 1000000
+#define SR_MICRO_NEXTHOPS 16
+
+/* n random prefixes, most of them /24s and few longer, as in a real
+   table, linked into a routing table list in the order they were made */
+static struct sr_rt* sr_micro_routes(unsigned int n)
+{
+    struct sr_rt* rt;
+    uint32_t r, mask;
+    unsigned int i;
+
+    rt = (struct sr_rt*)calloc(n, sizeof(struct sr_rt));
+    if(rt == 0)
+    { return 0; }
+    for(i = 0; i < n; i++)
+    {
+        r = sr_micro_rand();
+        rt[i].plen = (r % 100 < 60) ? 24 :
+                     (r % 100 < 99) ? 8 + (r >> 8) % 17 : 25 + (r >> 8) % 8;
+        mask = 0xffffffffU << (32 - rt[i].plen);
+        rt[i].mask.s_addr = htonl(mask);
+        rt[i].net = htonl(sr_micro_rand() & mask);
+        rt[i].dest.s_addr = rt[i].net;
+        /* -- a prefix made twice gets the same next hop both times -- */
+        rt[i].nh = 1 + (ntohl(rt[i].net) ^ rt[i].plen) % SR_MICRO_NEXTHOPS;
+        strcpy(rt[i].interface, "eth1");
+        rt[i].next = (i + 1 < n) ? &(rt[i + 1]) : 0;
+    }
+    return rt;
+}
+
+/* addresses to look up, host byte order: half inside one of the
+   prefixes, half anywhere */
+static uint32_t* sr_micro_addrs(struct sr_rt* rt, unsigned int n)
+{
+    uint32_t* a;
+    struct sr_rt* r;
+    unsigned int i;
+
+    a = (uint32_t*)malloc(SR_MICRO_LOOKUPS * sizeof(uint32_t));
+    if(a == 0)
+    { return 0; }
+    for(i = 0; i < SR_MICRO_LOOKUPS; i++)
+    {
+        r = &(rt[sr_micro_rand() % n]);
+        a[i] = (i & 1) ? sr_micro_rand() :
+               (ntohl(r->net) | (sr_micro_rand() & ~ntohl(r->mask.s_addr)));
+    }
+    return a;
+}
+
+/* the same answer: no route from either, or the same prefix */
+static int sr_micro_same(const struct sr_rt* a, const struct sr_rt* b)
+{
+    if(a == 0 || b == 0)
+    { return a == b; }
+    return a->net == b->net && a->plen == b->plen;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_lpm(..)
+ * Scope:  Local
+ *
+ * LPM() over the routing table list against the trie and DIR-24-8, at
+ * 10, 1k, 100k and 1M prefixes: time to build each index and time per
+ * lookup.  The list walk is linear, so it gets fewer lookups as the table
+ * grows.  Every answer the list gives must be the others' as well.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_lpm(void)
+{
+    static const unsigned int sizes[] = { 10, 1000, 100000, 1000000 };
+    struct sr_instance sr;
+    struct sr_trie* trie;
+    struct sr_dir248* dir;
+    struct sr_rt* rt;
+    struct sr_rt* hit;
+    uint32_t* addr;
+    unsigned int s, i, n, lookups, hits, wrong = 0;
+    double start, build, build248;
+
+    memset(&sr, 0, sizeof(sr));
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        n = sizes[s];
+        if((rt = sr_micro_routes(n)) == 0 || (addr = sr_micro_addrs(rt, n)) == 0)
+        {
+            fprintf(stderr, "Error: no memory for %u prefixes\n", n);
+            free(rt);
+            return -1;
+        }
+
+        start = sr_micro_now();
+        trie = sr_trie_create();
+        for(i = 0; i < n; i++)
+        { sr_trie_insert(trie, ntohl(rt[i].net), rt[i].plen, &(rt[i])); }
+        build = sr_micro_now() - start;
+
+        start = sr_micro_now();
+        if((dir = sr_dir248_create()) == 0)
+        {
+            fprintf(stderr, "Error: no memory for a DIR-24-8 table\n");
+            return -1;
+        }
+        for(i = 0; i < n; i++)
+        { sr_dir248_insert(dir, ntohl(rt[i].net), rt[i].plen, rt[i].nh); }
+        build248 = sr_micro_now() - start;
+
+        /* -- LPM() walks the list when no index has been built -- */
+        sr.routing_table = rt;
+        sr.rt_trie = 0;
+        lookups = 50000000 / n;
+        lookups = lookups > SR_MICRO_LOOKUPS ? SR_MICRO_LOOKUPS :
+                  lookups < 100 ? 100 : lookups;
+        hits = 0;
+        start = sr_micro_now();
+        for(i = 0; i < lookups; i++)
+        { hits += LPM(addr[i], &sr) != 0; }
+        printf("lpm: %7u prefixes  list   build %7s ms  lookup %10.1f ns  %u/%u hit\n",
+               n, "-", (sr_micro_now() - start) * 1e9 / lookups, hits, lookups);
+        for(i = 0; i < lookups; i++)
+        {
+            hit = LPM(addr[i], &sr);
+            sr.rt_trie = trie;
+            wrong += !sr_micro_same(hit, LPM(addr[i], &sr));
+            sr.rt_trie = 0;
+            wrong += (hit ? hit->nh : 0) != sr_dir248_lookup(dir, addr[i]);
+        }
+
+        sr.rt_trie = trie;
+        hits = 0;
+        start = sr_micro_now();
+        for(i = 0; i < SR_MICRO_LOOKUPS; i++)
+        { hits += LPM(addr[i], &sr) != 0; }
+        printf("lpm: %7u prefixes  trie   build %7.1f ms  lookup %10.1f ns  %u/%u hit\n",
+               n, build * 1e3, (sr_micro_now() - start) * 1e9 / SR_MICRO_LOOKUPS,
+               hits, SR_MICRO_LOOKUPS);
+
+        hits = 0;
+        start = sr_micro_now();
+        for(i = 0; i < SR_MICRO_LOOKUPS; i++)
+        { hits += sr_dir248_lookup(dir, addr[i]) != 0; }
+        printf("lpm: %7u prefixes  dir248 build %7.1f ms  lookup %10.1f ns  %u/%u hit\n",
+               n, build248 * 1e3, (sr_micro_now() - start) * 1e9 / SR_MICRO_LOOKUPS,
+               hits, SR_MICRO_LOOKUPS);
+
+        sr.rt_trie = 0;
+        sr_trie_destroy(trie);
+        sr_dir248_destroy(dir);
+        free(addr);
+        free(rt);
+    }
+
+    if(wrong)
+    { printf("lpm: %u lookups where an index and the list disagree\n", wrong); }
+    return wrong ? -1 : 0;
+} /* -- sr_micro_lpm -- */
+
+/* load a table of n /24 routes, each through a gateway of its own, and
+   count how many made it into the list */
+static int sr_micro_load(int engine, unsigned int n, unsigned int* listed)
+{
+    struct sr_instance sr;
+    struct sr_rt* rt;
+    char name[] = "/tmp/sr_micro_rtXXXXXX";
+    FILE* fp;
+    unsigned int i;
+    int fd, quiet, ret;
+
+    if((fd = mkstemp(name)) < 0 || (fp = fdopen(fd, "w")) == 0)
+    {
+        perror("mkstemp(..):sr_micro_load");
+        return -2;
+    }
+    for(i = 0; i < n; i++)
+    {
+        fprintf(fp, "10.%u.%u.0 1.0.%u.%u 255.255.255.0 eth1\n",
+                i >> 8 & 0xff, i & 0xff, i >> 8 & 0xff, i & 0xff);
+    }
+    fclose(fp);
+
+    memset(&sr, 0, sizeof(sr));
+    sr.fib_engine = engine;
+    quiet = sr_micro_mute();
+    ret = sr_load_rt(&sr, name);
+    sr_micro_unmute(quiet);
+    unlink(name);
+    for(*listed = 0, rt = sr.routing_table; rt != 0; rt = rt->next)
+    { (*listed)++; }
+    return ret;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_rtload(..)
+ * Scope:  Local
+ *
+ * DIR-24-8 can only hold SR_DIR248_MAX_NH next hops.  A table with that
+ * many must load, one with more must fail to, rather than load without
+ * the routes that did not fit, and without listing the one refused.
+ * The other engines take more.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_rtload(void)
+{
+    unsigned int listed;
+    int bad = 0;
+
+    if(sr_micro_load(fib_engine_dir248, SR_DIR248_MAX_NH, &listed) != 0)
+    {
+        printf("rtload: %u next hops did not load with dir248\n", SR_DIR248_MAX_NH);
+        bad++;
+    }
+    if(sr_micro_load(fib_engine_dir248, SR_DIR248_MAX_NH + 1, &listed) == 0)
+    {
+        printf("rtload: %u next hops loaded with dir248\n", SR_DIR248_MAX_NH + 1);
+        bad++;
+    }
+    if(listed != SR_DIR248_MAX_NH)
+    {
+        printf("rtload: %u routes listed after the %uth was refused\n",
+               listed, SR_DIR248_MAX_NH + 1);
+        bad++;
+    }
+    if(sr_micro_load(fib_engine_trie, SR_DIR248_MAX_NH + 1, &listed) != 0)
+    {
+        printf("rtload: %u next hops did not load with trie\n",
+               SR_DIR248_MAX_NH + 1);
+        bad++;
+    }
+    printf("rtload: next hop limits, %d wrong\n", bad);
+    return bad ? -1 : 0;
+} /* -- sr_micro_rtload -- */
+
+#define SR_MICRO_HEADERS 1000000
+
+/* the ip_id that makes the header sum to 0xffff without its checksum, so
+   cksum() comes out as 0xffff, the one's complement zero */
+static uint16_t sr_micro_zero_id(sr_ip_hdr_t* ip)
+{
+    uint32_t sum;
+
+    ip->ip_id = 0;
+    ip->ip_sum = 0;
+    sum = cksum_sum(ip, sizeof(sr_ip_hdr_t));
+    return htons(~sum & 0xffff);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_ttl(..)
+ * Scope:  Local
+ *
+ * ip_ttl_decrement() against recomputing the checksum with cksum(), over
+ * random headers and TTLs.  Every header is tried as it comes, made to
+ * have a checksum of 0xffff before the decrement, with that written as
+ * 0x0000 instead, and made to come out at 0xffff after it.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_ttl(void)
+{
+    static const char* kinds[] = { "random", "0xffff before", "0x0000 before",
+                                   "0xffff after" };
+    sr_ip_hdr_t ip, ref;
+    unsigned int i, k, tried[4] = { 0 }, wrong[4] = { 0 };
+    uint8_t* p;
+    int bad = 0;
+
+    micro_seed = 1;
+    for(i = 0; i < SR_MICRO_HEADERS; i++)
+    {
+        for(k = 0; k < 4; k++)
+        {
+            if(k == 0)
+            {
+                for(p = (uint8_t*)&ip; p < (uint8_t*)(&ip + 1); p++)
+                { *p = sr_micro_rand(); }
+                ip.ip_v = 4;
+                ip.ip_hl = 5;
+                ip.ip_ttl = 1 + sr_micro_rand() % 255;
+            }
+            else if(k == 1 || k == 2)
+            { ip.ip_id = sr_micro_zero_id(&ip); }
+            else
+            {
+                /* the id that zeroes the header once the TTL is one less */
+                ip.ip_ttl--;
+                ip.ip_id = sr_micro_zero_id(&ip);
+                ip.ip_ttl++;
+            }
+            ip.ip_sum = 0;
+            ip.ip_sum = cksum(&ip, sizeof(ip));
+            if(k == 2)
+            { ip.ip_sum = 0; }
+
+            ref = ip;
+            ref.ip_ttl--;
+            ref.ip_sum = 0;
+            ref.ip_sum = cksum(&ref, sizeof(ref));
+
+            ip_ttl_decrement(&ip);
+            tried[k]++;
+            if(ip.ip_sum != ref.ip_sum || !cksum_valid(&ip, sizeof(ip)))
+            {
+                if(wrong[k]++ == 0)
+                {
+                    printf("ttl: %s: ttl %u sum %04x, cksum() %04x\n",
+                           kinds[k], ip.ip_ttl, ntohs(ip.ip_sum),
+                           ntohs(ref.ip_sum));
+                }
+            }
+            ip.ip_ttl++;
+        }
+    }
+    for(k = 0; k < 4; k++)
+    {
+        printf("ttl: %u headers, %s, %u wrong\n", tried[k], kinds[k], wrong[k]);
+        bad += wrong[k];
+    }
+    return bad ? -1 : 0;
+} /* -- sr_micro_ttl -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_icmplimit(..)
+ * Scope:  Local
+ *
+ * ICMP limit specs, good and bad, and that a bucket refusing an error
+ * leaves the buckets before it as they were: src allows 5 in a burst
+ * and all 1, so after four refusals by all the source must still have
+ * four left once all is lifted.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_icmplimit(void)
+{
+    static const struct
+    {
+        const char* spec;
+        int ret;
+    } specs[] =
+    {
+        { "all=1000/50,if=200/20,src=10/5,len=24", 0 },
+        { "src=10",             0 },
+        { "off",                0 },
+        { "all=0",              0 },
+        { "all=1000000000",     0 },
+        { "all=1000000001",    -1 },
+        { "src=/5",            -1 },
+        { "src=5/",            -1 },
+        { "src=",              -1 },
+        { "src=5/x",           -1 },
+        { "src=-1",            -1 },
+        { "src=5/99999999999", -1 },
+        { "len=33",            -1 },
+        { "dst=5",             -1 },
+        { "src",               -1 },
+        { 0,                    0 }
+    };
+    struct sr_icmplimit* l;
+    uint32_t src = htonl(0x0a000002);
+    int i, n, nspecs, bad = 0;
+
+    for(nspecs = 0; specs[nspecs].spec; nspecs++)
+    {
+        if((l = sr_icmplimit_create()) == 0)
+        { return -1; }
+        n = sr_icmplimit_parse(l, specs[nspecs].spec);
+        if(n != specs[nspecs].ret)
+        {
+            printf("icmplimit: %s gave %d\n", specs[nspecs].spec, n);
+            bad++;
+        }
+        sr_icmplimit_destroy(l);
+    }
+
+    if((l = sr_icmplimit_create()) == 0)
+    { return -1; }
+    sr_icmplimit_parse(l, "src=1/5,all=1/1,len=32");
+    n = sr_icmplimit_allow(l, 0, src, 3, 0);
+    for(i = 0; i < 4; i++)
+    { n += sr_icmplimit_allow(l, 0, src, 3, 0); }
+    sr_icmplimit_parse(l, "all=0");
+    for(i = 0; i < 5; i++)
+    { n += sr_icmplimit_allow(l, 0, src, 3, 0); }
+    if(n != 5)
+    {
+        printf("icmplimit: %d of 10 allowed, not 5\n", n);
+        bad++;
+    }
+    sr_icmplimit_destroy(l);
+
+    printf("icmplimit: %d specs and a refused burst, %d wrong\n", nspecs, bad);
+    return bad ? -1 : 0;
+} /* -- sr_micro_icmplimit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_gen(..)
+ * Scope:  Local
+ *
+ * Traffic specs, good and bad, against a router with one interface and
+ * one route.  Signs, junk after a number and values out of range must be
+ * refused rather than read as something else.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_gen(void)
+{
+    static const unsigned char mac1[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+    static const struct
+    {
+        const char* spec;
+        int ok;
+    } specs[] =
+    {
+        { "fwd=90,arpreq=2,arprep=2,echo=3,ttl=2,badsum=1,dests=1000,zipf=1.1", 1 },
+        { "fwd=1,dests=0,len=1500,seed=18446744073709551615", 1 },
+        { "zipf=0",             1 },
+        { "fwd=1000001",        0 },
+        { "fwd=abc",            0 },
+        { "fwd=5x",             0 },
+        { "fwd=",               0 },
+        { "fwd=-5",             0 },
+        { "fwd=+5",             0 },
+        { "dests=-1",           0 },
+        { "dests=4194305",      0 },
+        { "len=1501",           0 },
+        { "zipf=-1",            0 },
+        { "zipf=1e999",         0 },
+        { "seed=18446744073709551616", 0 },
+        { "fwd",                0 },
+        { "rate=5",             0 },
+        { 0,                    0 }
+    };
+    struct sr_instance sr;
+    struct sr_gen* g;
+    struct in_addr dest, gw, mask;
+    int nspecs, bad = 0;
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr_add_interface(&sr, "eth1");
+    sr_set_ether_addr(&sr, mac1);
+    sr_set_ether_ip(&sr, htonl(0x0a010001));
+    dest.s_addr = htonl(0x0a010000);
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xffff0000);
+    sr_add_rt_entry(&sr, dest, gw, mask, "eth1");
+
+    for(nspecs = 0; specs[nspecs].spec; nspecs++)
+    {
+        g = sr_gen_create(&sr, specs[nspecs].spec);
+        if((g != 0) != specs[nspecs].ok)
+        {
+            printf("gen: %s was %s\n", specs[nspecs].spec,
+                   g ? "taken" : "refused");
+            bad++;
+        }
+        if(g)
+        { sr_gen_destroy(g); }
+    }
+
+    printf("gen: %d specs, %d wrong\n", nspecs, bad);
+    return bad ? -1 : 0;
+} /* -- sr_micro_gen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_refresh(..)
+ * Scope:  Local
+ *
+ * Two neighbours in use come up for a refresh, one with a route to it
+ * and one without.  Only the first may count as sent; the other is
+ * counted as dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_refresh(void)
+{
+    static const unsigned char mac1[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 9 };
+    struct timespec wait = { 0, 340000000 };
+    struct sr_arprefresh_stats rstats;
+    struct sr_arpentry entry;
+    struct sr_instance sr;
+    struct in_addr dest, gw, mask;
+    uint32_t routed = htonl(0x0a010002), unrouted = htonl(0x0b000002);
+    int quiet;
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.event_loop = 1;
+    sr_add_interface(&sr, "eth1");
+    sr_set_ether_addr(&sr, mac1);
+    sr_set_ether_ip(&sr, htonl(0x0a010001));
+    dest.s_addr = htonl(0x0a010000);
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xffff0000);
+    sr_add_rt_entry(&sr, dest, gw, mask, "eth1");
+    sr_init(&sr);
+    sr_arpcache_set_timers(&(sr.cache), 1000, 400);
+    sr_arpcache_insert(&(sr.cache), mac, routed);
+    sr_arpcache_insert(&(sr.cache), mac, unrouted);
+    sr_arpcache_lookup_copy(&(sr.cache), routed, &entry, 0);
+    sr_arpcache_lookup_copy(&(sr.cache), unrouted, &entry, 0);
+
+    /* -- past the refresh point at 320 ms, before the lifetime is up -- */
+    nanosleep(&wait, 0);
+    quiet = sr_micro_mute();
+    sr_arpcache_tick(&sr);
+    sr_micro_unmute(quiet);
+    sr_arpcache_refresh_stats(&(sr.cache), &rstats);
+    sr_arpcache_destroy(&(sr.cache));
+
+    printf("refresh: %lu sent, %lu dropped, expected 1 and 1\n",
+           rstats.sent, rstats.dropped);
+    return (rstats.sent == 1 && rstats.dropped == 1) ? 0 : -1;
+} /* -- sr_micro_refresh -- */
+
+#define SR_MICRO_NEIGHBOURS 65536
+#define SR_MICRO_SAMPLES    200000
+#define SR_MICRO_READERS    8
+
+struct sr_micro_reader
+{
+    struct sr_instance* sr;
+    uint32_t seed;
+    uint32_t* ns;               /* SR_MICRO_SAMPLES lookup times */
+    unsigned int hits;
+};
+
+static volatile int micro_stop;
+static unsigned long micro_writes;
+
+/* look neighbours up at random and time each lookup */
+static void* sr_micro_reader(void* arg)
+{
+    struct sr_micro_reader* r = (struct sr_micro_reader*)arg;
+    struct sr_arpentry entry;
+    struct timespec t0, t1;
+    uint32_t ip;
+    unsigned int i;
+
+    for(i = 0; i < SR_MICRO_SAMPLES; i++)
+    {
+        r->seed ^= r->seed << 13;
+        r->seed ^= r->seed >> 17;
+        r->seed ^= r->seed << 5;
+        ip = htonl(0x0a000000 + r->seed % SR_MICRO_NEIGHBOURS);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        r->hits += sr_arpcache_lookup_copy(&(r->sr->cache), ip, &entry, 0);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        r->ns[i] = (t1.tv_sec - t0.tv_sec) * 1000000000 +
+                   (t1.tv_nsec - t0.tv_nsec);
+    }
+    return 0;
+}
+
+/* what the cleanup thread does, flat out: run the timers and take
+   answers that renew entries, which rewrites them under the lock */
+static void* sr_micro_sweeper(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 0 };
+    uint32_t seed = 7, ip;
+    struct sr_arpreq* req;
+
+    while(!micro_stop)
+    {
+        sr_arpcache_tick(sr);
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        ip = htonl(0x0a000000 + seed % SR_MICRO_NEIGHBOURS);
+        memcpy(mac + 2, &ip, 4);
+        if((req = sr_arpcache_insert(&(sr->cache), mac, ip)) != 0)
+        { sr_arpreq_destroy(&(sr->cache), req); }
+        micro_writes++;
+    }
+    return 0;
+}
+
+static int sr_micro_u32cmp(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_arp(..)
+ * Scope:  Local
+ *
+ * ARP cache lookups from 1, 2, 4 and 8 reader threads, alone and with a
+ * sweeper thread running the timers and renewing entries as fast as it
+ * can.  Reports the p50 and p99 time of a single lookup; a reader that
+ * waited on the sweeper shows in the p99.  The times include two clock
+ * reads, whose cost is printed first.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_arp(void)
+{
+    static const unsigned char mac1[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+    struct sr_instance sr;
+    struct sr_micro_reader r[SR_MICRO_READERS];
+    struct in_addr dest, gw, mask;
+    pthread_t tid[SR_MICRO_READERS], sweeper;
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 0 };
+    struct timespec t0, t1;
+    uint32_t* ns;
+    uint32_t ip;
+    unsigned int i, n, hits, sweep, total;
+    int quiet, ret = 0;
+
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    sr.event_loop = 1;
+    sr_add_interface(&sr, "eth1");
+    sr_set_ether_addr(&sr, mac1);
+    sr_set_ether_ip(&sr, htonl(0x0a000001));
+    dest.s_addr = htonl(0x0a000000);
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xff000000);
+    sr_add_rt_entry(&sr, dest, gw, mask, "eth1");
+    sr_init(&sr);
+    /* short lifetimes, so the timers have entries to refresh and expire
+       while a run lasts */
+    sr_arpcache_set_timers(&(sr.cache), 5, 250);
+
+    if((ns = (uint32_t*)malloc(SR_MICRO_READERS * SR_MICRO_SAMPLES *
+                               sizeof(uint32_t))) == 0)
+    {
+        fprintf(stderr, "Error: no memory for lookup times\n");
+        return -1;
+    }
+    for(i = 0; i < 1000; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns[i] = (t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec);
+    }
+    qsort(ns, 1000, sizeof(uint32_t), sr_micro_u32cmp);
+    printf("arp: %u neighbours, clock reads %u ns\n", SR_MICRO_NEIGHBOURS,
+           ns[500]);
+
+    quiet = sr_micro_mute();
+    for(n = 1; n <= SR_MICRO_READERS && ret == 0; n *= 2)
+    {
+        for(sweep = 0; sweep < 2; sweep++)
+        {
+            for(i = 0; i < SR_MICRO_NEIGHBOURS; i++)
+            {
+                ip = htonl(0x0a000000 + i);
+                memcpy(mac + 2, &ip, 4);
+                sr_arpcache_insert(&(sr.cache), mac, ip);
+            }
+            micro_stop = 0;
+            micro_writes = 0;
+            if(sweep && pthread_create(&sweeper, 0, sr_micro_sweeper, &sr) != 0)
+            {
+                ret = -1;
+                break;
+            }
+            for(i = 0; i < n; i++)
+            {
+                r[i].sr = &sr;
+                r[i].seed = 1 + i;
+                r[i].ns = ns + i * SR_MICRO_SAMPLES;
+                r[i].hits = 0;
+                pthread_create(&(tid[i]), 0, sr_micro_reader, &(r[i]));
+            }
+            hits = 0;
+            for(i = 0; i < n; i++)
+            {
+                pthread_join(tid[i], 0);
+                hits += r[i].hits;
+            }
+            micro_stop = 1;
+            if(sweep)
+            { pthread_join(sweeper, 0); }
+
+            total = n * SR_MICRO_SAMPLES;
+            qsort(ns, total, sizeof(uint32_t), sr_micro_u32cmp);
+            sr_micro_unmute(quiet);
+            printf("arp: %u readers, %-11s p50 %5u ns  p99 %6u ns  max %8u ns  "
+                   "%.0f%% hit  %lu writes\n", n,
+                   sweep ? "sweeper" : "no sweeper", ns[total / 2],
+                   ns[total - total / 100], ns[total - 1],
+                   100.0 * hits / total, micro_writes);
+            quiet = sr_micro_mute();
+        }
+    }
+    sr_micro_unmute(quiet);
+
+    free(ns);
+    sr_arpcache_destroy(&(sr.cache));
+    return ret;
+} /* -- sr_micro_arp -- */
+
+#define SR_MICRO_CKSUM_BYTES (64 << 20)
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_cksum(..)
+ * Scope:  Local
+ *
+ * Each checksum kernel the CPU can run, in GB/s over buffers of 20, 64,
+ * 1500 and 9000 bytes: a header, a small frame, a full one and a jumbo.
+ * The kernels must agree on every sum.  Leaves the widest one in use.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_cksum(void)
+{
+    static const char* kernels[] = { "bytes", "64", "sse2", "avx2" };
+    static const int sizes[] = { 20, 64, 1500, 9000 };
+    uint8_t* buf;
+    uint32_t sum, first;
+    unsigned int k, s, i, n;
+    int wrong = 0;
+    double start, t;
+
+    if((buf = (uint8_t*)malloc(9000 + 1)) == 0)
+    { return -1; }
+    micro_seed = 1;
+    for(i = 0; i < 9001; i++)
+    { buf[i] = sr_micro_rand(); }
+
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        n = SR_MICRO_CKSUM_BYTES / sizes[s];
+        first = 0;
+        for(k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        {
+            if(cksum_use(kernels[k]) != 0)
+            {
+                printf("cksum: %5d bytes  %-5s not supported here\n",
+                       sizes[s], kernels[k]);
+                continue;
+            }
+            /* vary the start, so unaligned loads are timed too */
+            sum = 0;
+            start = sr_micro_now();
+            for(i = 0; i < n; i++)
+            { sum += cksum_sum(buf + (i & 1), sizes[s]); }
+            t = sr_micro_now() - start;
+            if(k == 0)
+            { first = sum; }
+            else if(sum != first)
+            { wrong++; }
+            printf("cksum: %5d bytes  %-5s %6.2f GB/s  %6.1f ns per buffer\n",
+                   sizes[s], kernels[k], (double)n * sizes[s] / t / 1e9,
+                   t * 1e9 / n);
+        }
+    }
+    if(cksum_use("avx2") != 0 && cksum_use("sse2") != 0)
+    { cksum_use("64"); }
+
+    free(buf);
+    if(wrong)
+    { printf("cksum: %d kernels disagree with bytes\n", wrong); }
+    return wrong ? -1 : 0;
+} /* -- sr_micro_cksum -- */
+
+#define SR_MICRO_VNS_MSGS 4000000
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_vns(..)
+ * Scope:  Local
+ *
+ * VNSPACKET commands through the receive buffer's framing from an
+ * in-memory stream, in msgs/s: read into the buffer as recv(..) would,
+ * in 64 KB pieces as a busy socket hands them over and in 1000 byte ones
+ * that split most commands, and take each command's type and interface
+ * as sr_vns_read(..) does.  Each frame carries a sequence number that
+ * must come out in order.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_vns(void)
+{
+    static const unsigned int frames[] = { 64, 1500 };
+    static const unsigned int reads[] = { 65536, 1000 };
+    struct sr_rxbuf* rb;
+    c_packet_header* hdr;
+    uint8_t* stream;
+    unsigned int f, r, i, n, msglen, msgs, slen, pos, room, got, seq, wrong = 0;
+    uint32_t type, next;
+    int len;
+    double start, t;
+
+    rb = (struct sr_rxbuf*)malloc(sizeof(struct sr_rxbuf));
+    stream = (uint8_t*)malloc(1 << 22);
+    if(rb == 0 || stream == 0)
+    {
+        free(rb);
+        free(stream);
+        return -1;
+    }
+
+    for(f = 0; f < sizeof(frames) / sizeof(frames[0]); f++)
+    {
+        msglen = sizeof(c_packet_header) + frames[f];
+        msgs = (1 << 22) / msglen;
+        slen = msgs * msglen;
+        memset(stream, 0, slen);
+        for(i = 0; i < msgs; i++)
+        {
+            hdr = (c_packet_header*)(stream + i * msglen);
+            hdr->mLen = htonl(msglen);
+            hdr->mType = htonl(VNSPACKET);
+            strcpy(hdr->mInterfaceName, "eth1");
+            memcpy((uint8_t*)(hdr + 1) + sizeof(sr_ethernet_hdr_t), &i, 4);
+        }
+
+        for(r = 0; r < sizeof(reads) / sizeof(reads[0]); r++)
+        {
+            rb->head = rb->tail = 0;
+            got = 0;
+            len = 0;
+            start = sr_micro_now();
+            while(got < SR_MICRO_VNS_MSGS && len >= 0)
+            {
+                next = 0;
+                for(pos = 0; pos < slen && len >= 0; pos += n)
+                {
+                    room = sr_rx_room(rb);
+                    n = slen - pos < reads[r] ? slen - pos : reads[r];
+                    n = n < room ? n : room;
+                    memcpy(rb->data + rb->tail, stream + pos, n);
+                    rb->tail += n;
+
+                    while((len = sr_rx_complete(rb)) > 0)
+                    {
+                        hdr = (c_packet_header*)(rb->data + rb->head);
+                        rb->head += len;
+                        memcpy(&type, &(hdr->mType), 4);
+                        if(ntohl(type) != VNSPACKET || hdr->mInterfaceName[0] != 'e')
+                        { wrong++; }
+                        memcpy(&seq, (uint8_t*)(hdr + 1) + sizeof(sr_ethernet_hdr_t), 4);
+                        wrong += seq != next++;
+                        got++;
+                    }
+                }
+            }
+            t = sr_micro_now() - start;
+            if(len < 0)
+            { wrong++; }
+            printf("vns: %4u byte frames, %5u byte reads  %6.2f M msgs/s  %6.2f GB/s\n",
+                   frames[f], reads[r], got / t / 1e6,
+                   (double)got * msglen / t / 1e9);
+        }
+    }
+
+    free(stream);
+    free(rb);
+    if(wrong)
+    { printf("vns: %u commands came out wrong\n", wrong); }
+    return wrong ? -1 : 0;
+} /* -- sr_micro_vns -- */
+
+#define SR_MICRO_TICKS 10000
+#define SR_MICRO_ARP_TICKS 200
+
+/* a timer that fires is put back n ms out, as a neighbour in use is */
+static void sr_micro_rearm(void* arg, int id, uint32_t key, int kind, void* ptr)
+{
+    struct sr_timers* w = (struct sr_timers*)arg;
+    sr_timer_add(w, w->now + key, key, kind, ptr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_timers(..)
+ * Scope:  Local
+ *
+ * Work per tick against the number of neighbours, 1k to 100k.  First the
+ * ARP cache with every entry far from due: sr_arpcache_tick(..) should
+ * take as long with 100k as with 1k.  Then the timer wheel alone on a
+ * clock of its own, n timers a millisecond apart that are put back n ms
+ * out as they fire, so one comes due every tick whatever n is: the time
+ * per tick should stay put as n grows.  The slowest ticks are the ones
+ * that move a coarser slot down a level, which holds the timers of that
+ * slot's span (4096 ms at the second level), not all n.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_micro_timers(void)
+{
+    static const unsigned int sizes[] = { 1000, 10000, 100000 };
+    unsigned char mac[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 0 };
+    struct timespec ms = { 0, 1000000 };
+    struct sr_instance sr;
+    struct sr_timers* w;
+    unsigned int s, i, n, fired;
+    uint32_t ip;
+    uint32_t* ns;
+    double start, t;
+    int quiet;
+
+    if((ns = (uint32_t*)malloc(SR_MICRO_TICKS * sizeof(uint32_t))) == 0)
+    { return -1; }
+
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        n = sizes[s];
+        memset(&sr, 0, sizeof(sr));
+        sr.sockfd = -1;
+        sr.event_loop = 1;
+        sr_init(&sr);
+        sr_arpcache_set_timers(&(sr.cache), 0, 600000);
+        for(i = 0; i < n; i++)
+        {
+            ip = htonl(0x0a000000 + i);
+            memcpy(mac + 2, &ip, 4);
+            sr_arpcache_insert(&(sr.cache), mac, ip);
+        }
+        quiet = sr_micro_mute();
+        for(i = 0; i < SR_MICRO_ARP_TICKS; i++)
+        {
+            /* -- the cache keeps real time, so let a millisecond pass -- */
+            nanosleep(&ms, 0);
+            t = sr_micro_now();
+            sr_arpcache_tick(&sr);
+            ns[i] = (sr_micro_now() - t) * 1e9;
+        }
+        sr_micro_unmute(quiet);
+        qsort(ns, SR_MICRO_ARP_TICKS, sizeof(uint32_t), sr_micro_u32cmp);
+        printf("timers: %6u neighbours  arp tick   p50 %6u ns  p99 %7u ns\n",
+               n, ns[SR_MICRO_ARP_TICKS / 2],
+               ns[SR_MICRO_ARP_TICKS - SR_MICRO_ARP_TICKS / 100]);
+        sr_arpcache_destroy(&(sr.cache));
+    }
+
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        n = sizes[s];
+        if((w = sr_timer_create(0)) == 0)
+        { return -1; }
+        for(i = 0; i < n; i++)
+        { sr_timer_add(w, 1 + i, n, 0, 0); }
+        fired = 0;
+        start = sr_micro_now();
+        for(i = 0; i < SR_MICRO_TICKS; i++)
+        {
+            t = sr_micro_now();
+            fired += sr_timer_run(w, i + 1, sr_micro_rearm, w);
+            ns[i] = (sr_micro_now() - t) * 1e9;
+        }
+        t = sr_micro_now() - start;
+        qsort(ns, SR_MICRO_TICKS, sizeof(uint32_t), sr_micro_u32cmp);
+        printf("timers: %6u timers      wheel tick p50 %6u ns  p99 %7u ns  "
+               "mean %6.1f ns  max %7u ns  %.2f fired per tick\n", n,
+               ns[SR_MICRO_TICKS / 2], ns[SR_MICRO_TICKS - SR_MICRO_TICKS / 100],
+               t * 1e9 / SR_MICRO_TICKS, ns[SR_MICRO_TICKS - 1],
+               (double)fired / SR_MICRO_TICKS);
+        sr_timer_destroy(w);
+    }
+    free(ns);
+    return 0;
+} /* -- sr_micro_timers -- */
+
+static const struct sr_micro_test sr_micro_tests[] =
+{
+    { "ifmap", 1, sr_micro_ifmap, "interface map parsing, overlong names" },
+    { "order", 1, sr_micro_order, "per-flow order through workers across ARP" },
+    { "rtload", 1, sr_micro_rtload, "routing tables with more next hops than fit" },
+    { "ttl",   1, sr_micro_ttl,   "TTL decrement checksum update against cksum()" },
+    { "icmplimit", 1, sr_micro_icmplimit, "ICMP limit specs, tokens kept when refused" },
+    { "refresh", 1, sr_micro_refresh, "ARP refreshes counted only when sent" },
+    { "gen",   1, sr_micro_gen,   "traffic specs, signs and values out of range" },
+    { "lpm",   0, sr_micro_lpm,   "LPM() list against trie and dir248, 10 to 1M prefixes" },
+    { "arp",   0, sr_micro_arp,   "ARP lookup p50/p99 from 1 to 8 readers, with a sweeper" },
+    { "cksum", 0, sr_micro_cksum, "checksum kernels in GB/s, 20 to 9000 bytes" },
+    { "vns",   0, sr_micro_vns,   "VNS command framing from memory in msgs/s" },
+    { "timers", 0, sr_micro_timers, "work per ARP timer tick, 1k to 100k neighbours" }
+};
+
+#define SR_MICRO_TESTS (sizeof(sr_micro_tests) / sizeof(sr_micro_tests[0]))
+
+void sr_micro_list(FILE* fp)
+{
+    unsigned int i;
+
+    for(i = 0; i < SR_MICRO_TESTS; i++)
+    {
+        fprintf(fp, "  %-10s %s %s\n", sr_micro_tests[i].name,
+                sr_micro_tests[i].check ? "check" : "bench",
+                sr_micro_tests[i].what);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_micro_run(..)
+ * Scope:  Global
+ *
+ * Run the tests named in a comma separated list.  Returns -1 if any
+ * failed or a name is unknown.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_micro_run(const char* names)
+{
+    const char* p = names;
+    size_t len;
+    unsigned int i;
+    int found, ret = 0;
+
+    while(*p)
+    {
+        len = strcspn(p, ",");
+        found = 0;
+        for(i = 0; i < SR_MICRO_TESTS; i++)
+        {
+            if(!(strncmp(p, sr_micro_tests[i].name, len) == 0 &&
+                 sr_micro_tests[i].name[len] == 0) &&
+               !(len == 5 && strncmp(p, "check", 5) == 0 &&
+                 sr_micro_tests[i].check) &&
+               !(len == 3 && strncmp(p, "all", 3) == 0))
+            { continue; }
+            found = 1;
+            fflush(stdout);
+            if(sr_micro_tests[i].run() != 0)
+            {
+                printf("%s: FAILED\n", sr_micro_tests[i].name);
+                ret = -1;
+            }
+        }
+        if(!found)
+        {
+            fprintf(stderr, "Error: no test %.*s\n", (int)len, p);
+            ret = -1;
+        }
+        p += len;
+        if(*p == ',')
+        { p++; }
+    }
+    return ret;
+} /* -- sr_micro_run -- */
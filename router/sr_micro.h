@@ -0,0 +1,34 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_micro.h
+ *
+ * Description:
+ *
+ * Microbenchmarks and self checks of single parts of the router, run by
+ * sr_bench -t instead of a replay.  Each is named; -t takes a comma
+ * separated list of names, "check" for every check or "all" for
+ * everything.  A check prints what it tried and fails if any of it came
+ * out wrong; a benchmark prints its figures.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_MICRO_H
+#define sr_MICRO_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* set by a check that watches what the router sends; sr_bench's stub
+   send path hands it every frame instead of counting it */
+extern void (*sr_micro_tx)(const uint8_t* buf, unsigned int len);
+
+int sr_micro_run(const char* names);
+void sr_micro_list(FILE* fp);
+
+#endif  /* --  sr_MICRO_H -- */
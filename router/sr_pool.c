@@ -0,0 +1,244 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.c
+ *
+ * Description:
+ *
+ * Packet buffer pool, see sr_pool.h.  The free lists are arrays of
+ * pointers rather than links threaded through the free buffers, so a
+ * stray write into a freed buffer cannot corrupt them.
+ *
+ * A thread's cache goes back to the shared stack when the thread exits.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "sr_pool.h"
+#include "sr_utils.h"
+
+struct sr_pool_cache
+{
+    struct sr_pool* pool;       /* pool the cached buffers belong to */
+    unsigned int n;
+    void* bufs[2 * SR_POOL_CACHE];
+};
+
+static __thread struct sr_pool_cache sr_pool_tc;
+static pthread_key_t sr_pool_key;
+static pthread_once_t sr_pool_once = PTHREAD_ONCE_INIT;
+
+#define SR_POOL_OWNS(p, b) \
+    ((uint8_t*)(b) >= (p)->slab && \
+     (uint8_t*)(b) < (p)->slab + (size_t)(p)->count * (p)->bufsz)
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_create(..)
+ * Scope:  Global
+ *
+ * Returns a pool of count buffers of bufsz bytes each, or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pool* sr_pool_create(unsigned int bufsz, unsigned int count)
+{
+    struct sr_pool* pool;
+    unsigned int i;
+
+    pool = (struct sr_pool*)calloc(1, sizeof(struct sr_pool));
+    if(pool == 0)
+    { return 0; }
+
+    /* -- keep every buffer 16 byte aligned -- */
+    pool->bufsz = (bufsz + 15) & ~15U;
+    pool->count = count;
+    pool->slab = (uint8_t*)malloc((size_t)pool->count * pool->bufsz);
+    pool->free = (void**)malloc(count * sizeof(void*));
+    if(pool->slab == 0 || pool->free == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_pool_create)\n");
+        sr_pool_destroy(pool);
+        return 0;
+    }
+
+    for(i = 0; i < count; i++)
+    { pool->free[i] = pool->slab + (size_t)(count - 1 - i) * pool->bufsz; }
+    pool->nfree = count;
+
+    pthread_mutex_init(&(pool->lock), 0);
+    return pool;
+} /* -- sr_pool_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_destroy(..)
+ * Scope:  Global
+ *
+ * Only safe once no thread will touch the pool again.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_destroy(struct sr_pool* pool)
+{
+    if(pool == 0)
+    { return; }
+
+    if(sr_pool_tc.pool == pool)
+    {
+        sr_pool_tc.pool = 0;
+        sr_pool_tc.n = 0;
+    }
+    if(pool->slab && pool->free)
+    { pthread_mutex_destroy(&(pool->lock)); }
+    free(pool->slab);
+    free(pool->free);
+    free(pool);
+} /* -- sr_pool_destroy -- */
+
+/* thread exit: return whatever the thread still has cached */
+static void sr_pool_drain(void* arg)
+{
+    struct sr_pool_cache* tc = (struct sr_pool_cache*)arg;
+    struct sr_pool* pool = tc->pool;
+
+    if(pool == 0 || tc->n == 0)
+    { return; }
+
+    pthread_mutex_lock(&(pool->lock));
+    while(tc->n > 0)
+    { pool->free[pool->nfree++] = tc->bufs[--tc->n]; }
+    pthread_mutex_unlock(&(pool->lock));
+}
+
+static void sr_pool_key_init(void)
+{
+    pthread_key_create(&sr_pool_key, sr_pool_drain);
+}
+
+/* the calling thread's cache if it may be used for pool, else 0 */
+static struct sr_pool_cache* sr_pool_cache(struct sr_pool* pool)
+{
+    struct sr_pool_cache* tc = &sr_pool_tc;
+
+    if(tc->pool != pool)
+    {
+        if(tc->n != 0)
+        { return 0; }
+        if(tc->pool == 0)
+        {
+            /* -- first use in this thread, arrange for the drain -- */
+            pthread_once(&sr_pool_once, sr_pool_key_init);
+            pthread_setspecific(sr_pool_key, tc);
+        }
+        tc->pool = pool;
+    }
+    return tc;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_get(..)
+ * Scope:  Global
+ *
+ * A buffer of at least len bytes, from the slab if possible.  pool may
+ * be 0, in which case this is a counted malloc().
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_pool_get(struct sr_pool* pool, unsigned int len)
+{
+    struct sr_pool_cache* tc;
+    void* buf = 0;
+
+    if(pool == 0)
+    { return sr_pkt_malloc(len); }
+
+    if(len <= pool->bufsz)
+    {
+        if((tc = sr_pool_cache(pool)) != 0)
+        {
+            if(tc->n == 0)
+            {
+                /* -- refill from the shared stack -- */
+                pthread_mutex_lock(&(pool->lock));
+                while(tc->n < SR_POOL_CACHE && pool->nfree > 0)
+                { tc->bufs[tc->n++] = pool->free[--pool->nfree]; }
+                pthread_mutex_unlock(&(pool->lock));
+            }
+            if(tc->n > 0)
+            { buf = tc->bufs[--tc->n]; }
+        }
+        else
+        {
+            pthread_mutex_lock(&(pool->lock));
+            if(pool->nfree > 0)
+            { buf = pool->free[--pool->nfree]; }
+            pthread_mutex_unlock(&(pool->lock));
+        }
+    }
+
+    if(buf == 0)
+    {
+        __atomic_add_fetch(&(pool->misses), 1, __ATOMIC_RELAXED);
+        return sr_pkt_malloc(len);
+    }
+
+    __atomic_add_fetch(&(pool->in_use), 1, __ATOMIC_RELAXED);
+    return buf;
+} /* -- sr_pool_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_put(..)
+ * Scope:  Global
+ *
+ * Return a buffer from sr_pool_get().  Any thread may return it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_put(struct sr_pool* pool, void* buf)
+{
+    struct sr_pool_cache* tc;
+
+    if(buf == 0)
+    { return; }
+
+    if(pool == 0 || !SR_POOL_OWNS(pool, buf))
+    {
+        free(buf);
+        return;
+    }
+
+    __atomic_sub_fetch(&(pool->in_use), 1, __ATOMIC_RELAXED);
+
+    if((tc = sr_pool_cache(pool)) == 0)
+    {
+        pthread_mutex_lock(&(pool->lock));
+        pool->free[pool->nfree++] = buf;
+        pthread_mutex_unlock(&(pool->lock));
+        return;
+    }
+
+    if(tc->n == 2 * SR_POOL_CACHE)
+    {
+        /* -- hand the older half back so other threads can have it -- */
+        pthread_mutex_lock(&(pool->lock));
+        memcpy(pool->free + pool->nfree, tc->bufs,
+               SR_POOL_CACHE * sizeof(void*));
+        pool->nfree += SR_POOL_CACHE;
+        pthread_mutex_unlock(&(pool->lock));
+        memmove(tc->bufs, tc->bufs + SR_POOL_CACHE,
+                SR_POOL_CACHE * sizeof(void*));
+        tc->n -= SR_POOL_CACHE;
+    }
+    tc->bufs[tc->n++] = buf;
+} /* -- sr_pool_put -- */
+
+unsigned long sr_pool_in_use(struct sr_pool* pool)
+{
+    return pool ? __atomic_load_n(&(pool->in_use), __ATOMIC_RELAXED) : 0;
+}
+
+unsigned long sr_pool_misses(struct sr_pool* pool)
+{
+    return pool ? __atomic_load_n(&(pool->misses), __ATOMIC_RELAXED) : 0;
+}
@@ -0,0 +1,54 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.h
+ *
+ * Description:
+ *
+ * Fixed-size packet buffer pool.  Buffers are carved out of one slab at
+ * startup and recycled, so the packet path does not go through malloc()
+ * and the heap does not fragment under load.  Each thread keeps a small
+ * cache of free buffers and only takes the pool lock to trade a batch of
+ * them with the shared free list.
+ *
+ * Requests the slab cannot serve (pool empty, or a buffer larger than
+ * bufsz) fall back to the heap and are counted as misses.  sr_pool_put()
+ * tells the two apart by address, so callers need not care which they got.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_POOL_H
+#define sr_POOL_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_POOL_BUF_SZ  2048    /* an MTU frame plus the VNS header, rounded up */
+#define SR_POOL_BUFS    4096    /* buffers in the default pool */
+#define SR_POOL_CACHE   64      /* buffers moved between a thread and the pool at once */
+
+struct sr_pool
+{
+    unsigned int bufsz;
+    unsigned int count;
+    uint8_t* slab;              /* count buffers of bufsz bytes */
+    void** free;                /* shared stack of free buffers */
+    unsigned int nfree;
+    unsigned long in_use;       /* slab buffers handed out, atomic */
+    unsigned long misses;       /* requests served from the heap, atomic */
+    pthread_mutex_t lock;       /* protects free/nfree */
+};
+
+struct sr_pool* sr_pool_create(unsigned int bufsz, unsigned int count);
+void sr_pool_destroy(struct sr_pool* );
+void* sr_pool_get(struct sr_pool* , unsigned int len);
+void sr_pool_put(struct sr_pool* , void* buf);
+unsigned long sr_pool_in_use(struct sr_pool* );
+unsigned long sr_pool_misses(struct sr_pool* );
+
+#endif  /* --  sr_POOL_H -- */
@@ -12,15 +12,19 @@
  **********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 
 #include "sr_if.h"
 #include "sr_rt.h"
+#include "sr_trie.h"
 #include "sr_router.h"
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_icmplimit.h"
+#include "sr_workers.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -37,6 +41,7 @@ void sr_init(struct sr_instance* sr)
 
     /* Initialize cache and cache cleanup thread */
     sr_arpcache_init(&(sr->cache));
+    sr->cache.pool = sr->pool;
 
     pthread_attr_init(&(sr->attr));
     pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
@@ -44,7 +49,10 @@ void sr_init(struct sr_instance* sr)
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
     pthread_t thread;
 
-    pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
+    /* the event loop runs the ARP timers itself */
+    if(!sr->event_loop){
+      pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
+    }
     
     /* Add initialization code here! */
 
@@ -102,98 +110,99 @@ void sr_handlearp (struct sr_instance* sr,
         unsigned int len, 
         char* interface)
 {
+  if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)){
+    return;
+  }
+
   /* get ethernet head */
   sr_ethernet_hdr_t *ehdr = (sr_ethernet_hdr_t *)packet;
 
   /* read arp head */
-  sr_arp_hdr_t *arpdr = (uint8_t *)malloc(sizeof(sr_arp_hdr_t));
-  memcpy(arpdr, packet+sizeof(sr_ethernet_hdr_t), sizeof(sr_arp_hdr_t));
+  sr_arp_hdr_t *arpdr = (sr_arp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
   
   if(ntohs(arpdr->ar_op) == 0x0001){
     /* It's arp request */
-    /* fill arp replay */
-    arpdr->ar_op = htons(0x0002);
-    /* Get and fill send arp header*/
+    /* turn it into the reply in place, over the interface's template */
     struct sr_if* arpIf = sr_get_interface(sr, interface);
-    memcpy(arpdr->ar_sha, arpIf->addr, ETHER_ADDR_LEN); 
-    memcpy(arpdr->ar_tha, ehdr->ether_shost, ETHER_ADDR_LEN); 
-    uint32_t temp = arpdr->ar_sip;
-    arpdr->ar_sip = arpdr->ar_tip;
-    arpdr->ar_tip = temp;
-    /* Create packet */
-    int templen = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
-    uint8_t *sendPacket = (uint8_t *)malloc(templen);
-
-    /* fill send ether header */
-    sr_ethernet_hdr_t *sendEhdr = (uint8_t *)malloc(sizeof(sr_ethernet_hdr_t));
-    memcpy(sendEhdr->ether_dhost, ehdr->ether_shost, ETHER_ADDR_LEN);
-    memcpy(sendEhdr->ether_shost, arpIf->addr, ETHER_ADDR_LEN);
-    sendEhdr->ether_type = htons(0x0806);
-    memcpy(sendPacket, sendEhdr, sizeof(sr_ethernet_hdr_t) );
-    memcpy(sendPacket + sizeof(sr_ethernet_hdr_t), arpdr, sizeof(sr_arp_hdr_t));
-    sr_send_packet(sr, sendPacket, templen, interface);
+    if(arpIf == NULL){
+      return;
+    }
+    unsigned char asker[ETHER_ADDR_LEN];
+    uint32_t askerIp = arpdr->ar_sip;
+    uint32_t askedIp = arpdr->ar_tip;
+    memcpy(asker, ehdr->ether_shost, ETHER_ADDR_LEN);
+
+    memcpy(packet, arpIf->tmpl.arp_rep, SR_ARP_FRAME_LEN);
+    memcpy(ehdr->ether_dhost, asker, ETHER_ADDR_LEN);
+    memcpy(arpdr->ar_tha, asker, ETHER_ADDR_LEN);
+    arpdr->ar_sip = askedIp;
+    arpdr->ar_tip = askerIp;
+    sr_send_packet(sr, packet, SR_ARP_FRAME_LEN, interface);
     return;            
   }
   else if(ntohs(arpdr->ar_op) == 0x0002){
     /* It's arp reply */
-    struct sr_arpreq * getReq = sr_arpcache_insert(&(sr->cache), arpdr->ar_sha, arpdr->ar_sip);
+    /* the queued packets go out before anyone else can find the entry and
+       send newer packets of the same flows ahead of them */
+    struct sr_arpreq * getReq = sr_arpcache_insert_begin(&(sr->cache), arpdr->ar_sip);
     if(getReq != NULL){
       /* forwarding! */
-      struct sr_packet* pPacket = getReq->packets;
-
-      while(pPacket != NULL){
-        uint8_t* outPacket = (uint8_t*) malloc(pPacket->len);
-        memcpy(outPacket, pPacket->buf, pPacket->len);
+      struct sr_packet* pPacket;
+      unsigned int i;
+
+      /* out the way the request was sent, else back where the answer came
+         in; the neighbour is on that link either way */
+      struct sr_if* if_walker = getReq->iface;
+      if(if_walker == NULL){
+        if_walker = sr_get_interface(sr, interface);
+      }
+      if(if_walker == NULL){
+        sr_arpcache_unsent(&(sr->cache), getReq->count);
+      }
 
-        sr_ethernet_hdr_t* sendEhdr = (uint8_t*) malloc(sizeof(sr_ethernet_hdr_t));
-        memcpy((uint8_t*)sendEhdr, outPacket, sizeof(sr_ethernet_hdr_t));
+      /* the queued copies are ours, rewrite them where they are */
+      for(i = 0; i < getReq->count && if_walker != NULL; i++){
+        pPacket = sr_arpreq_packet(getReq, i);
+        sr_ethernet_hdr_t* sendEhdr = (sr_ethernet_hdr_t*)pPacket->buf;
         memcpy(sendEhdr->ether_dhost, arpdr->ar_sha, ETHER_ADDR_LEN);
-        memcpy(sendEhdr->ether_shost, arpdr->ar_tha, ETHER_ADDR_LEN);
+        memcpy(sendEhdr->ether_shost, if_walker->addr, ETHER_ADDR_LEN);
         /* TLL decrement */
-        sr_ip_hdr_t* sendIp = (uint8_t*) malloc(sizeof(sr_ip_hdr_t));
-        memcpy((uint8_t*)sendIp, outPacket+sizeof(sr_ethernet_hdr_t), 
-          sizeof(sr_ip_hdr_t));
-        sendIp->ip_ttl = sendIp->ip_ttl - 1;
-        sendIp->ip_sum = 0;
-        sendIp->ip_sum = cksum(sendIp, sizeof(sr_ip_hdr_t));
-
-        memcpy(outPacket, sendEhdr, sizeof(sr_ethernet_hdr_t));
-        memcpy(outPacket+sizeof(sr_ethernet_hdr_t), sendIp, sizeof(sr_ip_hdr_t));
-
-        /*get interface name*/
-        struct sr_if* ifList = sr->if_list;
-        struct sr_if* if_walker = 0;
-        while(ifList != NULL){
-          if(!strncmp(ifList->addr,arpdr->ar_tha,ETHER_ADDR_LEN)){ 
-            if_walker = ifList;
-            break;
-          }
-          ifList = ifList->next;
+        sr_ip_hdr_t* sendIp = (sr_ip_hdr_t*)(pPacket->buf + sizeof(sr_ethernet_hdr_t));
+        ip_ttl_decrement(sendIp);
+
+        /* with workers, each goes out through its own flow's worker */
+        if(sr->workers == NULL ||
+           sr_workers_handback(sr->workers, pPacket->buf, pPacket->len,
+                               if_walker->name) != 0){
+          sr_send_packet(sr, pPacket->buf, pPacket->len, if_walker->name);
         }
-        sr_send_packet(sr, outPacket, pPacket->len, if_walker->name);
-        pPacket = pPacket->next;
       }
     }
+    sr_arpcache_insert_end(&(sr->cache), arpdr->ar_sha, arpdr->ar_sip);
     sr_arpreq_destroy(&(sr->cache), getReq);
     return;
   }
 } 
 
-/* This func is for handle ip packet */
+/* This func is for handle ip packet. Nothing is copied or allocated here:
+   replies and forwarded packets are rewritten in the receive buffer and
+   sent straight from it. */
 void sr_handleip(struct sr_instance* sr, 
       uint8_t * packet, 
       unsigned int len, 
       char* interface)
 {
-  /* Check sum*/
-  sr_ip_hdr_t *ipdrIn = (uint8_t*) malloc(sizeof(sr_ip_hdr_t));
-  memcpy(ipdrIn, packet+sizeof(sr_ethernet_hdr_t), sizeof(sr_ip_hdr_t));
-  /* extract without sum ip header */
-  uint8_t* ipdrNoSum = (uint8_t*) malloc(sizeof(sr_ip_hdr_t)-2);
-  memcpy(ipdrNoSum, (uint8_t*)ipdrIn, sizeof(sr_ip_hdr_t)-10);
-  memcpy(ipdrNoSum+sizeof(sr_ip_hdr_t)-10, (uint8_t*)ipdrIn+sizeof(sr_ip_hdr_t)-8, 8);
-  /* compare */
-  if (ipdrIn->ip_sum == cksum (ipdrNoSum, sizeof(sr_ip_hdr_t)-2)){
+  if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)){
+    return;
+  }
+
+  /* Check sum, over the header as it lies in the packet */
+  sr_ip_hdr_t *ipdrIn = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+  unsigned int ipHdrLen = ipdrIn->ip_hl * 4;
+  if(ipHdrLen < sizeof(sr_ip_hdr_t) || len < sizeof(sr_ethernet_hdr_t) + ipHdrLen){
+    return;
+  }
+  if (cksum_valid(ipdrIn, ipHdrLen)){
     /*the check sum is right*/
 
     if(ipdrIn->ip_ttl == 1){
@@ -222,46 +231,31 @@ void sr_handleip(struct sr_instance* sr,
       uint8_t ipProtocol = ipdrIn->ip_p;
       if(ipProtocol == 0x0001){
         /* it's ICMP */
-        /* create packet */
-        uint8_t *outPacket = (uint8_t*) malloc(len);
-
-        /* create out icmp not 3 header */
-        sr_icmp_hdr_t* sendIcmp = (uint8_t*) malloc(len-sizeof(sr_ethernet_hdr_t)-sizeof(sr_ip_hdr_t));
-        memcpy(sendIcmp, packet+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t), 
-          len-sizeof(sr_ip_hdr_t)-sizeof(sr_ethernet_hdr_t));
+        /* turn the echo request into the reply in place */
+        unsigned int icmpLen = len - sizeof(sr_ethernet_hdr_t) - ipHdrLen;
+        if(icmpLen < sizeof(sr_icmp_hdr_t)){
+          return;
+        }
+        sr_icmp_hdr_t* sendIcmp = (sr_icmp_hdr_t*)((uint8_t*)ipdrIn + ipHdrLen);
         sendIcmp->icmp_type = 0;
-        uint8_t* icmpNoSum = (uint8_t*) malloc(len-sizeof(sr_ethernet_hdr_t)-sizeof(sr_ip_hdr_t)-2);
-        memcpy(icmpNoSum, (uint8_t*)sendIcmp, 2);
-        memcpy(icmpNoSum+2, (uint8_t*)sendIcmp+4, len-sizeof(sr_ethernet_hdr_t)-sizeof(sr_ip_hdr_t)-4);
-        sendIcmp->icmp_sum = cksum(icmpNoSum, len-sizeof(sr_ethernet_hdr_t)-sizeof(sr_ip_hdr_t)-2);
-        
-        /* create out ip header */
-        sr_ip_hdr_t *sendIp = (uint8_t*) malloc(sizeof(sr_ip_hdr_t));
-        memcpy(sendIp, packet+sizeof(sr_ethernet_hdr_t), sizeof(sr_ip_hdr_t));
-        uint32_t tempIp = sendIp->ip_dst;
-        sendIp->ip_dst = sendIp->ip_src;
-        sendIp->ip_src = tempIp;
+        sendIcmp->icmp_sum = 0;
+        sendIcmp->icmp_sum = cksum(sendIcmp, icmpLen);
         
-        uint8_t* ipNoSum = (uint8_t*) malloc(sizeof(sr_ip_hdr_t)-2);
-        memcpy(ipNoSum, (uint8_t*)sendIp, sizeof(sr_ip_hdr_t)-10);
-        memcpy(ipNoSum+sizeof(sr_ip_hdr_t)-10, (uint8_t*)sendIp+sizeof(sr_ip_hdr_t)-8, 8);
-        sendIp->ip_sum = cksum (ipNoSum, sizeof(sr_ip_hdr_t)-2);
+        /* fill ip header */
+        uint32_t tempIp = ipdrIn->ip_dst;
+        ipdrIn->ip_dst = ipdrIn->ip_src;
+        ipdrIn->ip_src = tempIp;
+        ipdrIn->ip_sum = 0;
+        ipdrIn->ip_sum = cksum (ipdrIn, ipHdrLen);
         
         /* fill send ether header */
-        sr_ethernet_hdr_t *sendEhdr = (uint8_t *)malloc(sizeof(sr_ethernet_hdr_t));
-        memcpy(sendEhdr, packet, sizeof(sr_ethernet_hdr_t));
-        uint8_t* tempEthAddr = (uint8_t*) malloc(ETHER_ADDR_LEN);
+        sr_ethernet_hdr_t *sendEhdr = (sr_ethernet_hdr_t *)packet;
+        uint8_t tempEthAddr[ETHER_ADDR_LEN];
         memcpy(tempEthAddr, sendEhdr->ether_dhost, ETHER_ADDR_LEN);
         memcpy(sendEhdr->ether_dhost, sendEhdr->ether_shost, ETHER_ADDR_LEN);
         memcpy(sendEhdr->ether_shost, tempEthAddr, ETHER_ADDR_LEN);
         
-        /* fill packet */
-        memcpy(outPacket, sendEhdr, sizeof(sr_ethernet_hdr_t));
-        memcpy(outPacket+sizeof(sr_ethernet_hdr_t), sendIp, sizeof(sr_ip_hdr_t));
-        memcpy(outPacket+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t), 
-          sendIcmp, len-sizeof(sr_ethernet_hdr_t)-sizeof(sr_ip_hdr_t));
-        
-        sr_send_packet(sr, outPacket, len, interface);
+        sr_send_packet(sr, packet, len, interface);
         return;
       }
       else{
@@ -274,49 +268,40 @@ void sr_handleip(struct sr_instance* sr,
     else{
       /* this packet is not for me */
       /* LPM */
-      struct sr_rt* selectedSr = LPM(destIp, sr);
-      if(selectedSr != NULL){
+      uint16_t nh = sr_rt_lookup(sr, destIp);
+      if(nh != 0){
         /* rtable ip matched */
+        struct sr_nexthop* hop = &(sr->nexthops[nh]);
+        /* directly connected routes may have no gateway */
+        uint32_t hopIp = hop->gw.s_addr ? hop->gw.s_addr : htonl(destIp);
+        /* get out-interface; workers may race to resolve it, but they
+           all store the same pointer */
+        struct sr_if* outIf = __atomic_load_n(&(hop->iface), __ATOMIC_RELAXED);
+        if(outIf == NULL){
+          outIf = sr_get_interface(sr, hop->interface);
+          __atomic_store_n(&(hop->iface), outIf, __ATOMIC_RELAXED);
+        }
         /* check if in cache */     
-        struct sr_arpentry * findEntry = sr_arpcache_lookup(&(sr->cache), htonl(destIp));
-        if(findEntry == NULL){
-          /* not in cache, add arp request in queue*/
-          sr_arpcache_queuereq(&(sr->cache), htonl(destIp), packet, len, interface);                                     
+        struct sr_arpentry findEntry;
+        int found = sr_arpcache_lookup_copy(&(sr->cache), hopIp, &findEntry, NULL);
+        /* not in cache, add arp request in queue, to be asked for on
+           the out-interface only; look again if it was answered meanwhile,
+           otherwise the packet was dropped */
+        if(!found && sr_arpcache_queuereq(&(sr->cache), hopIp, packet, len,
+                                          interface, outIf) == NULL){
+          found = sr_arpcache_lookup_copy(&(sr->cache), hopIp, &findEntry, NULL);
         }
-        else{
+        if(found){
           /* forwarding */
 
-
-          /* get out-interface */
-          struct sr_if* outIf = sr_get_interface(sr, selectedSr->interface);
-          /* get dest-mac */
-          uint8_t *macAddr = (uint8_t *) malloc(6);
-          memcpy(macAddr, findEntry->mac, 6);
-          
-          uint8_t* outPacket = (uint8_t*) malloc(len);
-          memcpy(outPacket, packet, len);
-
-          sr_ethernet_hdr_t* sendEhdr = (uint8_t*) malloc(sizeof(sr_ethernet_hdr_t));
-          memcpy((uint8_t*)sendEhdr, outPacket, sizeof(sr_ethernet_hdr_t));
-          memcpy(sendEhdr->ether_dhost, macAddr, ETHER_ADDR_LEN);
+          /* rewrite the frame where it is */
+          sr_ethernet_hdr_t* sendEhdr = (sr_ethernet_hdr_t*)packet;
+          memcpy(sendEhdr->ether_dhost, findEntry.mac, ETHER_ADDR_LEN);
           memcpy(sendEhdr->ether_shost, outIf->addr, ETHER_ADDR_LEN);
           /* TLL decrement */
-          sr_ip_hdr_t* sendIp = (uint8_t*) malloc(sizeof(sr_ip_hdr_t));
-          memcpy((uint8_t*)sendIp, outPacket+sizeof(sr_ethernet_hdr_t), 
-            sizeof(sr_ip_hdr_t));
-          /* check ttl */ 
-          sendIp->ip_ttl = sendIp->ip_ttl - 1;
-
-
-          sendIp->ip_sum = 0;
-          sendIp->ip_sum = cksum(sendIp, sizeof(sr_ip_hdr_t));
+          ip_ttl_decrement(ipdrIn);
 
-          memcpy(outPacket, sendEhdr, sizeof(sr_ethernet_hdr_t));
-          memcpy(outPacket+sizeof(sr_ethernet_hdr_t), sendIp, sizeof(sr_ip_hdr_t));
-
-          sr_send_packet(sr, outPacket, len, outIf->name);
-
-          free(findEntry);
+          sr_send_packet(sr, packet, len, outIf->name);
         }
       }
       else{
@@ -333,45 +318,32 @@ void sr_handleip(struct sr_instance* sr,
   }
 }
 
-/* this func is for calculate LPM */
+/* this func is for calculate LPM, ip is in host byte order */
 struct sr_rt* LPM(uint32_t ip, struct sr_instance *sr){
   struct sr_rt *temproutingtable = sr->routing_table;
-  int counter = 0;
-  struct sr_rt *result;
-  uint8_t map[8] = {128,192,224,240,248,252,254,255};
-  while(temproutingtable != NULL){
-    uint8_t m1 = (ntohl(temproutingtable->mask.s_addr) & 0xff000000)>>24;
-    uint8_t m2 = (ntohl(temproutingtable->mask.s_addr) & 0x00ff0000)>>16;
-    uint8_t m3 = (ntohl(temproutingtable->mask.s_addr) & 0x0000ff00)>>8;
-    uint8_t m4 = (ntohl(temproutingtable->mask.s_addr) & 0x000000ff);
-    int c_mask = 0;
-    int i;
-    for(i = 0; i < 8; i++){
-      if(m1 == map[i]){
-        c_mask = i + 1;
-      }
-    }
-    for(i = 0; i < 8; i++){
-      if(m2 == map[i]){
-        c_mask = c_mask + i + 1;
-      }
-    }
-    for(i = 0; i < 8; i++){
-      if(m3 == map[i]){
-        c_mask = c_mask + i + 1;
-      }
-    }
-    for(i = 0; i < 8; i++){
-      if(m4 == map[i]){
-        c_mask = c_mask + i + 1;
+  struct sr_rt *result = NULL;
+  uint32_t nip = htonl(ip);
+  unsigned int i;
+
+  if(sr->rt_trie != NULL){
+    return sr_trie_lookup(sr->rt_trie, ip);
+  }
+
+  if(sr->rt_array != NULL){
+    /* sorted longest first, the first match is the answer */
+    for(i = 0; i < sr->rt_array_len; i++){
+      if((nip & sr->rt_array[i].mask.s_addr) == sr->rt_array[i].net){
+        return &(sr->rt_array[i]);
       }
     }
-    uint32_t tempdest = ntohl(temproutingtable->dest.s_addr) & ntohl(temproutingtable->mask.s_addr);
-    if (tempdest == (ip & ntohl(temproutingtable->mask.s_addr))){
-      if (counter < c_mask){
-        counter = c_mask;
-        result = temproutingtable;
-      }
+    return NULL;
+  }
+
+  /* no index with DIR-24-8, walk the list */
+  while(temproutingtable != NULL){
+    if((nip & temproutingtable->mask.s_addr) == temproutingtable->net &&
+       (result == NULL || result->plen < temproutingtable->plen)){
+      result = temproutingtable;
     }
     temproutingtable = temproutingtable->next;
   }
@@ -381,51 +353,53 @@ struct sr_rt* LPM(uint32_t ip, struct sr_instance *sr){
 /* this func is for send icmp3 not icmp  */
 void sr_send_icmp3(struct sr_instance *sr, uint8_t * packet, unsigned int len, uint8_t icmp_type,
   uint8_t icmp_code, char* interface){
-  int len1 = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t);
-  uint8_t *outPacket = (uint8_t *) malloc(len1);
-  sr_icmp_t3_hdr_t * sendIcmp = (uint8_t*) malloc(sizeof(sr_icmp_t3_hdr_t));
+  uint8_t outPacket[SR_ICMP3_FRAME_LEN];
+  sr_ethernet_hdr_t *sendEhdr = (sr_ethernet_hdr_t *)outPacket;
+  sr_ip_hdr_t *sendIp = (sr_ip_hdr_t *)(outPacket + sizeof(sr_ethernet_hdr_t));
+  sr_icmp_t3_hdr_t *sendIcmp = (sr_icmp_t3_hdr_t *)((uint8_t *)sendIp + sizeof(sr_ip_hdr_t));
+  sr_ip_hdr_t *ipIn = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  unsigned int dataLen = len - sizeof(sr_ethernet_hdr_t);
+  struct sr_if* myIf;
+  uint32_t sum;
+
+  if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)){
+    return;
+  }
+  if((myIf = sr_get_interface(sr, interface)) == NULL){
+    return;
+  }
+  /* over the limit: drop it before building anything */
+  if(sr->icmplimit &&
+     !sr_icmplimit_allow(sr->icmplimit, myIf, ipIn->ip_src, icmp_type, icmp_code)){
+    return;
+  }
+  if(dataLen > ICMP_DATA_SIZE){
+    dataLen = ICMP_DATA_SIZE;
+  }
+
+  /* start from the interface's template, whose data is zeroed */
+  memcpy(outPacket, myIf->tmpl.icmp3, sizeof(outPacket));
+  memcpy(sendEhdr->ether_dhost, ((sr_ethernet_hdr_t *)packet)->ether_shost, ETHER_ADDR_LEN);
+
   sendIcmp->icmp_type = icmp_type;
   sendIcmp->icmp_code = icmp_code;
-  memcpy(sendIcmp->data, packet+sizeof(sr_ethernet_hdr_t), ICMP_DATA_SIZE);
-  sendIcmp->icmp_sum = 0;
-  sendIcmp->icmp_sum = cksum(sendIcmp, sizeof(sr_icmp_t3_hdr_t));
-
-  sr_ip_hdr_t *sendIp = (uint8_t*) malloc(sizeof(sr_ip_hdr_t));
-  memcpy(sendIp, packet+sizeof(sr_ethernet_hdr_t), sizeof(sr_ip_hdr_t));
-  sendIp->ip_len = htons(sizeof(sr_ip_hdr_t)+ sizeof(sr_icmp_t3_hdr_t));
-  sendIp->ip_p = ip_protocol_icmp;
+  memcpy(sendIcmp->data, ipIn, dataLen);
+  sum = (icmp_type << 8 | icmp_code) + cksum_sum(sendIcmp->data, dataLen);
+  sendIcmp->icmp_sum = cksum_done(sum);
 
-  /*  loop for its if */
+  /* from the address it was sent to if that is ours, else the interface */
   struct sr_if* ifList = sr->if_list;
-  uint32_t tempIp = 0;
+  sendIp->ip_src = myIf->ip;
   while(ifList != NULL){
-    if(sendIp->ip_dst == ifList->ip){
-      tempIp = ifList->ip;
+    if(ipIn->ip_dst == ifList->ip){
+      sendIp->ip_src = ifList->ip;
       break;
     }
     ifList = ifList->next;
   }
-  if(tempIp == 0){
-    struct sr_if* myIf = sr_get_interface(sr, interface);
-    tempIp = myIf->ip;
-  }
-  sendIp->ip_dst = sendIp->ip_src;
-  sendIp->ip_src = tempIp;
-  sendIp->ip_ttl = INIT_TTL;
-  sendIp->ip_sum = 0;
-  sendIp->ip_sum = cksum(sendIp, sizeof(sr_ip_hdr_t));
-
-  sr_ethernet_hdr_t *sendEhdr = (uint8_t*) malloc(sizeof(sr_ethernet_hdr_t));
-  memcpy(sendEhdr, packet, sizeof(sr_ethernet_hdr_t));
-  uint8_t* tempEthAddr = (uint8_t*) malloc(ETHER_ADDR_LEN);
-  memcpy(tempEthAddr, sendEhdr->ether_dhost, ETHER_ADDR_LEN);
-  memcpy(sendEhdr->ether_dhost, sendEhdr->ether_shost, ETHER_ADDR_LEN);
-  memcpy(sendEhdr->ether_shost, tempEthAddr, ETHER_ADDR_LEN);
-
-  memcpy(outPacket, sendEhdr, sizeof(sr_ethernet_hdr_t));
-  memcpy(outPacket+sizeof(sr_ethernet_hdr_t), sendIp, sizeof(sr_ip_hdr_t));
-  memcpy(outPacket+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t), sendIcmp, 
-    sizeof(sr_icmp_t3_hdr_t));
-
-  sr_send_packet(sr,outPacket,len1,interface);
-}
\ No newline at end of file
+  sendIp->ip_dst = ipIn->ip_src;
+  sum = cksum_add32(myIf->tmpl.icmp3_ip_sum, sendIp->ip_src);
+  sendIp->ip_sum = cksum_done(cksum_add32(sum, sendIp->ip_dst));
+
+  sr_send_packet(sr, outPacket, sizeof(outPacket), interface);
+}
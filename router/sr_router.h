@@ -33,6 +33,17 @@
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_trie;
+struct sr_dir248;
+struct sr_nexthop;
+struct sr_pool;
+struct sr_txq;
+struct sr_rxbuf;
+struct sr_workers;
+struct sr_afpacket;
+struct sr_xsk;
+struct sr_capture;
+struct sr_icmplimit;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -51,9 +62,30 @@ struct sr_instance
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_rt* rt_tail;       /* last entry of routing_table */
+    struct sr_trie* rt_trie;     /* LPM index over routing_table */
+    int fib_engine;              /* enum sr_fib_engine */
+    struct sr_dir248* rt_dir248; /* used instead of rt_trie if selected */
+    struct sr_rt* rt_array;      /* copy of routing_table, longest first */
+    unsigned int rt_array_len;
+    unsigned int rt_array_cap;
+    int rt_array_dirty;          /* rt_array needs sorting */
+    struct sr_nexthop* nexthops; /* next hops by index, see sr_rt.h */
+    unsigned int nexthops_len;
+    unsigned int nexthops_cap;
+    uint16_t* nh_hash;           /* nexthops index by gw/interface */
+    struct sr_pool* pool;        /* packet buffers, see sr_pool.h */
+    struct sr_txq* txq;          /* frames waiting for sr_flush_packets */
+    struct sr_rxbuf* rxb;        /* bytes read from the server, see sr_vns_comm.c */
     struct sr_arpcache cache;   /* ARP cache */
+    int event_loop;              /* no ARP thread, main runs sr_event_loop */
+    struct sr_workers* workers;  /* forwarding threads, see sr_workers.h */
+    struct sr_afpacket* afp;     /* host interfaces instead of VNS, see sr_afpacket.h */
+    struct sr_xsk* xsk;          /* the same through AF_XDP, see sr_xsk.h */
     pthread_attr_t attr;
     FILE* logfile;
+    struct sr_capture* capture;  /* writes logfile off the packet path, see sr_capture.h */
+    struct sr_icmplimit* icmplimit; /* ICMP error rate limits, may be 0 */
 };
 
 /* -- sr_main.c -- */
@@ -61,8 +93,13 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_tx_submit(struct sr_instance* , uint8_t* , unsigned int , const char*);
+void sr_deliver_packet(struct sr_instance* , uint8_t* , unsigned int , char* );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+int sr_event_loop(struct sr_instance* );
+int sr_flush_packets(struct sr_instance* );
+void sr_tx_counters(struct sr_instance* , unsigned long* , unsigned long* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
@@ -20,8 +20,20 @@
 #include <arpa/inet.h>
 
 #include "sr_rt.h"
+#include "sr_trie.h"
+#include "sr_dir248.h"
 #include "sr_router.h"
 
+#define SR_NH_HASH_SZ (2 * (SR_NEXTHOP_MAX + 1))
+
+static void sr_rt_clear(struct sr_instance* sr);
+static int sr_rt_append(struct sr_instance* sr, struct in_addr dest,
+                         struct in_addr gw, struct in_addr mask,
+                         char* if_name);
+static void sr_rt_sort(struct sr_instance* sr);
+static uint16_t sr_rt_nexthop(struct sr_instance* sr, struct in_addr gw,
+                              const char* if_name);
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -76,22 +88,56 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
+            sr_rt_clear(sr);
             clear_routing_table = 1;
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
+        if(sr_rt_append(sr,dest_addr,gw_addr,mask_addr,iface) != 0)
+        {
+            fclose(fp);
+            return -1;
+        }
     } /* -- while -- */
 
+    fclose(fp);
+
+    /* -- sort once for the whole file rather than per entry -- */
+    sr_rt_sort(sr);
+
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
 /*---------------------------------------------------------------------
  * Method:
  *
+ * Returns -1, without adding the route, if it is refused.
  *---------------------------------------------------------------------*/
 
-void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
+int sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
 struct in_addr gw, struct in_addr mask,char* if_name)
+{
+    if(sr_rt_append(sr, dest, gw, mask, if_name) != 0)
+    {
+        fprintf(stderr, "Error adding route to %s\n", inet_ntoa(dest));
+        return -1;
+    }
+    sr_rt_sort(sr);
+    return 0;
+} /* -- sr_add_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_append(..)
+ * Scope:  Local
+ *
+ * Add an entry to the list and to the selected engine.  The sorted
+ * array is only appended to; sr_rt_sort() restores its order.  Returns
+ * -1, with nothing added, if the route got no next hop or the engine
+ * could not take it.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt_append(struct sr_instance* sr, struct in_addr dest,
+                         struct in_addr gw, struct in_addr mask,
+                         char* if_name)
 {
     struct sr_rt* rt_walker = 0;
 
@@ -99,37 +145,236 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
+    rt_walker = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+    assert(rt_walker);
+
+    rt_walker->next = 0;
+    rt_walker->dest = dest;
+    rt_walker->gw   = gw;
+    rt_walker->mask = mask;
+    rt_walker->plen = sr_rt_prefix_len(mask);
+    rt_walker->net  = dest.s_addr & mask.s_addr;
+    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+
+    if((rt_walker->nh = sr_rt_nexthop(sr, gw, if_name)) == 0)
+    {
+        free(rt_walker);
+        return -1;
+    }
+
+    /* -- index it for the selected forwarding engine -- */
+    if(sr->fib_engine == fib_engine_dir248)
+    {
+        if(sr->rt_dir248 == 0)
+        { sr->rt_dir248 = sr_dir248_create(); }
+        if(sr->rt_dir248 == 0 ||
+           sr_dir248_insert(sr->rt_dir248, ntohl(dest.s_addr),
+                            rt_walker->plen, rt_walker->nh) != 0)
+        {
+            fprintf(stderr, "Error adding %s to DIR-24-8 table\n",
+                    inet_ntoa(dest));
+            free(rt_walker);
+            return -1;
+        }
+    }
+    else if(sr->fib_engine == fib_engine_sorted)
+    {
+        if(sr->rt_array_len == sr->rt_array_cap)
+        {
+            sr->rt_array_cap = sr->rt_array_cap ? 2 * sr->rt_array_cap : 16;
+            sr->rt_array = (struct sr_rt*)realloc(sr->rt_array,
+                    sr->rt_array_cap * sizeof(struct sr_rt));
+            assert(sr->rt_array);
+        }
+        if(sr->rt_array_len > 0 &&
+           sr->rt_array[sr->rt_array_len - 1].plen < rt_walker->plen)
+        { sr->rt_array_dirty = 1; }
+        sr->rt_array[sr->rt_array_len] = *rt_walker;
+        sr->rt_array[sr->rt_array_len].next = 0;
+        sr->rt_array_len++;
+    }
+    else
+    {
+        if(sr->rt_trie == 0)
+        { sr->rt_trie = sr_trie_create(); }
+        sr_trie_insert(sr->rt_trie, ntohl(dest.s_addr),
+                       rt_walker->plen, rt_walker);
+    }
+
+    /* -- append only once accepted, keeping the tail so bulk loads
+     *    stay linear -- */
     if(sr->routing_table == 0)
+    { sr->routing_table = rt_walker; }
+    else
+    { sr->rt_tail->next = rt_walker; }
+    sr->rt_tail = rt_walker;
+
+    return 0;
+} /* -- sr_rt_append -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_sort(..)
+ * Scope:  Local
+ *
+ * Order rt_array by descending prefix length so the first match is the
+ * longest one.  A counting sort on the 33 possible lengths is linear and
+ * stable, so of two identical prefixes the one added first still wins.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_sort(struct sr_instance* sr)
+{
+    unsigned int start[34];
+    struct sr_rt* sorted;
+    unsigned int i;
+    int len;
+
+    if(!sr->rt_array_dirty)
+    { return; }
+
+    memset(start, 0, sizeof(start));
+    for(i = 0; i < sr->rt_array_len; i++)
+    { start[32 - sr->rt_array[i].plen + 1]++; }
+    for(len = 1; len < 34; len++)
+    { start[len] += start[len - 1]; }
+
+    sorted = (struct sr_rt*)malloc(sr->rt_array_cap * sizeof(struct sr_rt));
+    assert(sorted);
+    for(i = 0; i < sr->rt_array_len; i++)
+    { sorted[start[32 - sr->rt_array[i].plen]++] = sr->rt_array[i]; }
+
+    free(sr->rt_array);
+    sr->rt_array = sorted;
+    sr->rt_array_dirty = 0;
+} /* -- sr_rt_sort -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_clear(..)
+ * Scope:  Local
+ *
+ * Forget the current table and everything built from it.  The list
+ * itself is leaked as it always has been.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_clear(struct sr_instance* sr)
+{
+    sr->routing_table = 0;
+    sr->rt_tail = 0;
+    sr_trie_destroy(sr->rt_trie);
+    sr->rt_trie = 0;
+    sr_dir248_destroy(sr->rt_dir248);
+    sr->rt_dir248 = 0;
+    sr->rt_array_len = 0;
+    sr->rt_array_dirty = 0;
+    sr->nexthops_len = 0;
+    if(sr->nh_hash)
+    { memset(sr->nh_hash, 0, SR_NH_HASH_SZ * sizeof(uint16_t)); }
+} /* -- sr_rt_clear -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_nexthop(..)
+ * Scope:  Local
+ *
+ * Return the index of the gw/interface pair, adding it to the next-hop
+ * array if it is new.  Returns 0 if the array is full.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t sr_rt_nexthop(struct sr_instance* sr, struct in_addr gw,
+                              const char* if_name)
+{
+    struct sr_nexthop* hop;
+    uint32_t h;
+    const char* c;
+    uint16_t nh;
+    unsigned int max;
+
+    if(sr->nh_hash == 0)
     {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        sr->nh_hash = (uint16_t*)calloc(SR_NH_HASH_SZ, sizeof(uint16_t));
+        assert(sr->nh_hash);
+    }
 
-        return;
+    /* -- FNV-1a over gateway and interface name -- */
+    h = 2166136261U ^ gw.s_addr;
+    for(c = if_name; *c && c < if_name + sr_IFACE_NAMELEN; c++)
+    { h = (h ^ (uint8_t)*c) * 16777619U; }
+
+    for(h %= SR_NH_HASH_SZ; (nh = sr->nh_hash[h]) != 0;
+        h = (h + 1) % SR_NH_HASH_SZ)
+    {
+        hop = &(sr->nexthops[nh]);
+        if(hop->gw.s_addr == gw.s_addr &&
+           strncmp(hop->interface, if_name, sr_IFACE_NAMELEN) == 0)
+        { return nh; }
     }
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+    /* -- DIR-24-8 entries keep a bit for themselves -- */
+    max = sr->fib_engine == fib_engine_dir248 ? SR_DIR248_MAX_NH : SR_NEXTHOP_MAX;
+    if(sr->nexthops_len == max)
+    {
+        fprintf(stderr, "Error: more than %u next hops\n", max);
+        return 0;
     }
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+    /* -- slot 0 is reserved for "no route" -- */
+    if(sr->nexthops_len + 1 >= sr->nexthops_cap)
+    {
+        sr->nexthops_cap = sr->nexthops_cap ? 2 * sr->nexthops_cap : 16;
+        sr->nexthops = (struct sr_nexthop*)realloc(sr->nexthops,
+                sr->nexthops_cap * sizeof(struct sr_nexthop));
+        assert(sr->nexthops);
+    }
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+    nh = ++sr->nexthops_len;
+    hop = &(sr->nexthops[nh]);
+    hop->gw = gw;
+    strncpy(hop->interface, if_name, sr_IFACE_NAMELEN);
+    hop->iface = 0;
+    sr->nh_hash[h] = nh;
 
-} /* -- sr_add_entry -- */
+    return nh;
+} /* -- sr_rt_nexthop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_lookup(..)
+ * Scope:  Global
+ *
+ * Longest prefix match for ip (host byte order) through whichever
+ * engine was selected.  Returns a next-hop index, 0 if there is no route.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_rt_lookup(struct sr_instance* sr, uint32_t ip)
+{
+    struct sr_rt* rt;
+
+    if(sr->rt_dir248)
+    { return sr_dir248_lookup(sr->rt_dir248, ip); }
+
+    rt = LPM(ip, sr);
+    return rt ? rt->nh : 0;
+} /* -- sr_rt_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_prefix_len(..)
+ *
+ * Number of leading one bits in a netmask.  Masks are expected to be
+ * contiguous; any bits after the first zero are ignored.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_prefix_len(struct in_addr mask)
+{
+    uint32_t m = ntohl(mask.s_addr);
+    int len = 0;
+
+    while(len < 32 && (m & (0x80000000U >> len)))
+    { len++; }
+
+    return len;
+} /* -- sr_rt_prefix_len -- */
 
 /*---------------------------------------------------------------------
  * Method:
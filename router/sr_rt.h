@@ -33,13 +33,44 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    uint32_t net;               /* dest & mask, network byte order */
+    uint8_t  plen;              /* prefix length of mask */
+    uint16_t nh;                /* index into sr_instance::nexthops */
     struct sr_rt* next;
 };
 
+/* ----------------------------------------------------------------------------
+ * struct sr_nexthop
+ *
+ * Distinct gateway/interface pairs referenced by the routing table.  The
+ * forwarding engines hand back an index into this array; index 0 is never
+ * used and means "no route".
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_nexthop
+{
+    struct in_addr gw;
+    char   interface[sr_IFACE_NAMELEN];
+    struct sr_if* iface;        /* resolved on first use, interfaces arrive
+                                   after the routing table is loaded */
+};
+
+#define SR_NEXTHOP_MAX 0xffff
+
+/* forwarding engines selectable at startup */
+enum sr_fib_engine {
+  fib_engine_trie = 0,
+  fib_engine_dir248,
+  fib_engine_sorted
+};
+
 
 int sr_load_rt(struct sr_instance*,const char*);
-void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
+int sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
+int sr_rt_prefix_len(struct in_addr mask);
+uint16_t sr_rt_lookup(struct sr_instance* sr, uint32_t ip);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
@@ -0,0 +1,253 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Description:
+ *
+ * Timer wheel, see sr_timer.h.  The placement rule is the classic one: a
+ * timer due within 64 ms goes in level 0 at slot (expires & 63); one due
+ * within 64^2 ms in level 1 at slot ((expires >> 6) & 63), and so on.  When
+ * level 0 wraps, the level 1 slot for the next 64 ms is emptied and its
+ * timers placed again, which now puts them in level 0; level 2 is emptied
+ * the same way when level 1 wraps.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_timer.h"
+
+#define SR_TIMER_MASK    (SR_TIMER_SLOTS - 1)
+#define SR_TIMER_SPAN    ((uint64_t)1 << (SR_TIMER_BITS * SR_TIMER_LEVELS))
+
+/* put a node that is on no list into the slot for its deadline */
+static void sr_timer_link(struct sr_timers* w, int id)
+{
+    struct sr_timer* t = &(w->nodes[id]);
+    uint64_t delta;
+    int level, slot;
+
+    if(t->expires < w->now)
+    { t->expires = w->now; }
+    delta = t->expires - w->now;
+    if(delta >= SR_TIMER_SPAN)
+    {
+        t->expires = w->now + SR_TIMER_SPAN - 1;
+        delta = SR_TIMER_SPAN - 1;
+    }
+
+    for(level = 0; level < SR_TIMER_LEVELS - 1; level++)
+    {
+        if(delta < ((uint64_t)1 << (SR_TIMER_BITS * (level + 1))))
+        { break; }
+    }
+    slot = (t->expires >> (SR_TIMER_BITS * level)) & SR_TIMER_MASK;
+
+    t->level = level;
+    t->slot = slot;
+    t->prev = SR_TIMER_NONE;
+    t->next = w->wheel[level][slot];
+    if(t->next != SR_TIMER_NONE)
+    { w->nodes[t->next].prev = id; }
+    w->wheel[level][slot] = id;
+}
+
+static void sr_timer_unlink(struct sr_timers* w, int id)
+{
+    struct sr_timer* t = &(w->nodes[id]);
+
+    if(t->prev != SR_TIMER_NONE)
+    { w->nodes[t->prev].next = t->next; }
+    else
+    { w->wheel[t->level][t->slot] = t->next; }
+    if(t->next != SR_TIMER_NONE)
+    { w->nodes[t->next].prev = t->prev; }
+}
+
+static void sr_timer_release(struct sr_timers* w, int id)
+{
+    w->nodes[id].level = -1;
+    w->nodes[id].next = w->free;
+    w->free = id;
+    w->count--;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_create(..)
+ * Scope:  Global
+ *
+ * An empty wheel whose clock starts at now (ms).
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_timers* sr_timer_create(uint64_t now)
+{
+    struct sr_timers* w;
+    int l, s;
+
+    w = (struct sr_timers*)calloc(1, sizeof(struct sr_timers));
+    assert(w);
+
+    w->now = now;
+    w->free = SR_TIMER_NONE;
+    for(l = 0; l < SR_TIMER_LEVELS; l++)
+    {
+        for(s = 0; s < SR_TIMER_SLOTS; s++)
+        { w->wheel[l][s] = SR_TIMER_NONE; }
+    }
+    return w;
+} /* -- sr_timer_create -- */
+
+void sr_timer_destroy(struct sr_timers* w)
+{
+    if(w == 0)
+    { return; }
+    free(w->nodes);
+    free(w);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_add(..)
+ * Scope:  Global
+ *
+ * Schedule a timer for expires (ms).  A deadline already past fires on
+ * the next sr_timer_run().  Returns the timer's id.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_timer_add(struct sr_timers* w, uint64_t expires, uint32_t key,
+                 int kind, void* ptr)
+{
+    struct sr_timer* t;
+    unsigned int i, cap;
+    int id;
+
+    if(w->free == SR_TIMER_NONE)
+    {
+        /* -- grow; ids stay valid because they are indices -- */
+        cap = w->nodes_cap ? w->nodes_cap * 2 : 256;
+        t = (struct sr_timer*)realloc(w->nodes, cap * sizeof(struct sr_timer));
+        assert(t);
+        w->nodes = t;
+        for(i = cap; i > w->nodes_cap; i--)
+        {
+            t[i - 1].level = -1;
+            t[i - 1].next = w->free;
+            w->free = i - 1;
+        }
+        w->nodes_cap = cap;
+    }
+
+    id = w->free;
+    t = &(w->nodes[id]);
+    w->free = t->next;
+    w->count++;
+
+    t->expires = expires;
+    t->key = key;
+    t->kind = kind;
+    t->ptr = ptr;
+    sr_timer_link(w, id);
+    return id;
+} /* -- sr_timer_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_cancel(..)
+ * Scope:  Global
+ *
+ * Forget a pending timer.  SR_TIMER_NONE is ignored.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_cancel(struct sr_timers* w, int id)
+{
+    if(id == SR_TIMER_NONE)
+    { return; }
+    assert(w->nodes[id].level >= 0);
+
+    sr_timer_unlink(w, id);
+    sr_timer_release(w, id);
+} /* -- sr_timer_cancel -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_mod(..)
+ * Scope:  Global
+ *
+ * Move a pending timer to a new deadline, keeping its id.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_mod(struct sr_timers* w, int id, uint64_t expires)
+{
+    assert(w->nodes[id].level >= 0);
+
+    sr_timer_unlink(w, id);
+    w->nodes[id].expires = expires;
+    sr_timer_link(w, id);
+} /* -- sr_timer_mod -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_run(..)
+ * Scope:  Global
+ *
+ * Advance the clock to now (ms), calling fn for every timer that comes
+ * due on the way.  Returns the number of timers fired.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_run(struct sr_timers* w, uint64_t now, sr_timer_fn fn,
+                          void* arg)
+{
+    struct sr_timer* t;
+    unsigned int fired = 0;
+    uint64_t ms;
+    int l, slot, id, next;
+
+    while(w->now <= now)
+    {
+        if(w->count == 0)
+        {
+            /* -- nothing pending, no slot to visit on the way -- */
+            w->now = now + 1;
+            break;
+        }
+
+        ms = w->now;
+
+        /* -- level 0 wrapped: bring the next stretch down a level -- */
+        if((ms & SR_TIMER_MASK) == 0)
+        {
+            for(l = 1; l < SR_TIMER_LEVELS; l++)
+            {
+                slot = (ms >> (SR_TIMER_BITS * l)) & SR_TIMER_MASK;
+                id = w->wheel[l][slot];
+                w->wheel[l][slot] = SR_TIMER_NONE;
+                for(; id != SR_TIMER_NONE; id = next)
+                {
+                    next = w->nodes[id].next;
+                    sr_timer_link(w, id);
+                }
+                if(slot != 0)
+                { break; }
+            }
+        }
+
+        /* -- detach the due slot first; fn may add timers -- */
+        slot = ms & SR_TIMER_MASK;
+        id = w->wheel[0][slot];
+        w->wheel[0][slot] = SR_TIMER_NONE;
+        w->now = ms + 1;
+
+        for(; id != SR_TIMER_NONE; id = next)
+        {
+            t = &(w->nodes[id]);
+            next = t->next;
+            sr_timer_release(w, id);
+            fired++;
+            fn(arg, id, t->key, t->kind, t->ptr);
+        }
+    }
+
+    return fired;
+} /* -- sr_timer_run -- */
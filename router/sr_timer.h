@@ -0,0 +1,72 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Description:
+ *
+ * Hierarchical timer wheel with millisecond resolution.  Four levels of
+ * 64 slots cover deadlines up to 2^24 ms (about 4.6 hours) ahead; a timer
+ * sits in the coarsest level that can hold it and is moved down a level
+ * each time that level's slot comes round.  Adding and cancelling a timer
+ * are O(1), and advancing the wheel touches only the slots it passes and
+ * the timers that are due, however many are pending.
+ *
+ * Timers are named by index rather than pointer, so the nodes can live in
+ * one growable array.  They carry a key and a pointer for the owner to
+ * find what expired; the ARP cache keys its entries by IP because they
+ * move around its hash table.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_TIMER_H
+#define sr_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_BITS    6
+#define SR_TIMER_SLOTS   (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS  4
+#define SR_TIMER_NONE    (-1)
+
+struct sr_timer
+{
+    uint64_t expires;           /* ms */
+    uint32_t key;
+    int kind;
+    void* ptr;
+    int next;                   /* slot list, or free list */
+    int prev;
+    short level;                /* -1 while free */
+    short slot;
+};
+
+struct sr_timers
+{
+    uint64_t now;               /* next millisecond not yet run */
+    struct sr_timer* nodes;
+    unsigned int nodes_cap;
+    int free;                   /* first free node */
+    unsigned int count;         /* timers pending */
+    int wheel[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+};
+
+/* called for each timer that comes due; the timer is already gone, so
+   the callback may add timers, including in place of this one */
+typedef void (*sr_timer_fn)(void* arg, int id, uint32_t key, int kind,
+                            void* ptr);
+
+struct sr_timers* sr_timer_create(uint64_t now);
+void sr_timer_destroy(struct sr_timers* );
+int sr_timer_add(struct sr_timers* , uint64_t expires, uint32_t key,
+                 int kind, void* ptr);
+void sr_timer_cancel(struct sr_timers* , int id);
+void sr_timer_mod(struct sr_timers* , int id, uint64_t expires);
+unsigned int sr_timer_run(struct sr_timers* , uint64_t now, sr_timer_fn fn,
+                          void* arg);
+
+#endif  /* --  sr_TIMER_H -- */
@@ -0,0 +1,219 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trie.c
+ *
+ * Description:
+ *
+ * Path-compressed binary trie used for longest prefix match.  Addresses and
+ * prefixes are handled in host byte order; bit 0 is the most significant
+ * bit of the address.
+ *
+ * Nodes are carved out of fixed-size blocks rather than malloc'd one by one
+ * so that a table with a million routes stays reasonably dense in memory.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_trie.h"
+
+#define SR_TRIE_BLOCK_NODES 1024
+
+#define SR_TRIE_MASK(len) ((len) ? (0xffffffffU << (32 - (len))) : 0)
+#define SR_TRIE_BIT(key, pos) (((key) >> (31 - (pos))) & 1)
+
+struct sr_trie_block
+{
+    struct sr_trie_block* next;
+    unsigned int used;
+    struct sr_trie_node nodes[SR_TRIE_BLOCK_NODES];
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_trie_node_new(..)
+ * Scope:  Local
+ *
+ * Take a node from the current block, starting a new block if full.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_trie_node* sr_trie_node_new(struct sr_trie* trie,
+        uint32_t key, int len, struct sr_rt* route)
+{
+    struct sr_trie_block* block = trie->blocks;
+    struct sr_trie_node* node;
+
+    if(block == 0 || block->used == SR_TRIE_BLOCK_NODES)
+    {
+        block = (struct sr_trie_block*)malloc(sizeof(struct sr_trie_block));
+        assert(block);
+        block->used = 0;
+        block->next = trie->blocks;
+        trie->blocks = block;
+    }
+
+    node = &(block->nodes[block->used++]);
+    node->key = key;
+    node->len = len;
+    node->route = route;
+    node->child[0] = 0;
+    node->child[1] = 0;
+
+    trie->nodes++;
+    if(route)
+    { trie->routes++; }
+
+    return node;
+} /* -- sr_trie_node_new -- */
+
+/* number of leading bits a and b have in common */
+static int sr_trie_common_len(uint32_t a, uint32_t b)
+{
+    uint32_t diff = a ^ b;
+    if(diff == 0)
+    { return 32; }
+    return __builtin_clz(diff);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_trie_create()
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_trie* sr_trie_create(void)
+{
+    struct sr_trie* trie = (struct sr_trie*)calloc(1, sizeof(struct sr_trie));
+    assert(trie);
+    return trie;
+} /* -- sr_trie_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trie_destroy(..)
+ * Scope:  Global
+ *
+ * Free the trie.  Routes are owned by the routing table and left alone.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trie_destroy(struct sr_trie* trie)
+{
+    struct sr_trie_block* block;
+
+    if(trie == 0)
+    { return; }
+
+    while((block = trie->blocks) != 0)
+    {
+        trie->blocks = block->next;
+        free(block);
+    }
+    free(trie);
+} /* -- sr_trie_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trie_insert(..)
+ * Scope:  Global
+ *
+ * Add prefix/len -> route.  If the prefix is already present the first
+ * route inserted is kept, which matches the first-entry-wins behaviour of
+ * the old list walk in LPM().
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trie_insert(struct sr_trie* trie, uint32_t prefix, int len,
+                   struct sr_rt* route)
+{
+    struct sr_trie_node** link;
+    struct sr_trie_node* node;
+    struct sr_trie_node* leaf;
+    struct sr_trie_node* glue;
+    int common;
+
+    /* -- REQUIRES -- */
+    assert(trie);
+    assert(route);
+
+    if(len < 0 || len > 32)
+    { return -1; }
+
+    prefix &= SR_TRIE_MASK(len);
+    link = &(trie->root);
+
+    while((node = *link) != 0)
+    {
+        common = sr_trie_common_len(prefix, node->key);
+        if(common > len)
+        { common = len; }
+        if(common > node->len)
+        { common = node->len; }
+
+        if(common < node->len)
+        {
+            /* -- prefix leaves this node's path: splice in above it -- */
+            leaf = sr_trie_node_new(trie, prefix, len, route);
+            if(common == len)
+            {
+                leaf->child[SR_TRIE_BIT(node->key, len)] = node;
+                *link = leaf;
+            }
+            else
+            {
+                glue = sr_trie_node_new(trie, prefix & SR_TRIE_MASK(common),
+                                        common, 0);
+                glue->child[SR_TRIE_BIT(prefix, common)] = leaf;
+                glue->child[SR_TRIE_BIT(node->key, common)] = node;
+                *link = glue;
+            }
+            return 0;
+        }
+
+        if(node->len == len)
+        {
+            if(node->route == 0)
+            {
+                node->route = route;
+                trie->routes++;
+            }
+            return 0;
+        }
+
+        link = &(node->child[SR_TRIE_BIT(prefix, node->len)]);
+    } /* -- while -- */
+
+    *link = sr_trie_node_new(trie, prefix, len, route);
+    return 0;
+} /* -- sr_trie_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trie_lookup(..)
+ * Scope:  Global
+ *
+ * Longest prefix match for ip (host byte order).  Returns 0 if no prefix
+ * covers the address.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_trie_lookup(const struct sr_trie* trie, uint32_t ip)
+{
+    const struct sr_trie_node* node;
+    struct sr_rt* best = 0;
+
+    if(trie == 0)
+    { return 0; }
+
+    node = trie->root;
+    while(node)
+    {
+        if((ip & SR_TRIE_MASK(node->len)) != node->key)
+        { break; }
+        if(node->route)
+        { best = node->route; }
+        if(node->len == 32)
+        { break; }
+        node = node->child[SR_TRIE_BIT(ip, node->len)];
+    }
+
+    return best;
+} /* -- sr_trie_lookup -- */
@@ -0,0 +1,57 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trie.h
+ *
+ * Description:
+ *
+ * Path-compressed binary (Patricia) trie over IPv4 prefixes.  Built from
+ * the routing table list as entries are added and used by LPM() so that a
+ * lookup visits at most one node per significant prefix bit instead of
+ * every route in the table.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_TRIE_H
+#define sr_TRIE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_rt;
+struct sr_trie_block;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_trie_node
+ *
+ * A node holds the prefix bits shared by everything below it.  Glue nodes
+ * created when two prefixes diverge carry no route.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_trie_node
+{
+    uint32_t key;                       /* prefix bits, host byte order */
+    uint8_t  len;                       /* number of significant bits   */
+    struct sr_rt* route;                /* route for key/len, 0 if glue */
+    struct sr_trie_node* child[2];
+};
+
+struct sr_trie
+{
+    struct sr_trie_node* root;
+    struct sr_trie_block* blocks;       /* node storage, see sr_trie.c  */
+    unsigned int nodes;
+    unsigned int routes;
+};
+
+struct sr_trie* sr_trie_create(void);
+void sr_trie_destroy(struct sr_trie* );
+int sr_trie_insert(struct sr_trie* , uint32_t prefix, int len,
+                   struct sr_rt* route);
+struct sr_rt* sr_trie_lookup(const struct sr_trie* , uint32_t ip);
+
+#endif  /* --  sr_TRIE_H -- */
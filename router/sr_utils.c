@@ -5,7 +5,10 @@
 #include "sr_utils.h"
 
 
-uint16_t cksum (const void *_data, int len) {
+/* Ones' complement sum of len bytes folded to 16 bits, in host order.
+   This is the reference; the kernels below must agree with it bit for
+   bit. */
+static uint32_t cksum_fold_bytes (const void *_data, int len) {
   const uint8_t *data = _data;
   uint32_t sum;
 
@@ -15,10 +18,201 @@ uint16_t cksum (const void *_data, int len) {
     sum += data[0] << 8;
   while (sum > 0xffff)
     sum = (sum >> 16) + (sum & 0xffff);
+  return sum;
+}
+
+/* The wide kernels add the buffer in native byte order, which gives the
+   byte-swapped sum on a little endian host (RFC 1071, section 2.B), and
+   fix it up once at the end.  A trailing odd byte is padded in memory so
+   that it lands in the right half of its word either way. */
+static uint32_t cksum_finish (uint64_t sum, const uint8_t *tail, int odd) {
+  uint16_t last = 0;
+
+  if (odd) {
+    memcpy(&last, tail, 1);
+    sum += last;
+  }
+  while (sum > 0xffff)
+    sum = (sum >> 16) + (sum & 0xffff);
+  return ntohs((uint16_t)sum);
+}
+
+/* 64 bit accumulator, 8 bytes per step with the carry folded back in.
+   sum carries in whatever a vector kernel has already added up. */
+static uint32_t cksum_fold_64_from (uint64_t sum, const uint8_t *data, int len) {
+  uint64_t w;
+  uint32_t w32;
+  uint16_t w16;
+
+  for (; len >= 8; data += 8, len -= 8) {
+    memcpy(&w, data, 8);
+    sum += w;
+    sum += (sum < w);
+  }
+  if (len >= 4) {
+    memcpy(&w32, data, 4);
+    sum += w32;
+    sum += (sum < w32);
+    data += 4;
+    len -= 4;
+  }
+  if (len >= 2) {
+    memcpy(&w16, data, 2);
+    sum += w16;
+    sum += (sum < w16);
+    data += 2;
+    len -= 2;
+  }
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  return cksum_finish(sum, data, len);
+}
+
+static uint32_t cksum_fold_64 (const void *_data, int len) {
+  return cksum_fold_64_from(0, _data, len);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CKSUM_X86
+
+/* The vector kernels widen 32 bit words into 64 bit lanes and add them
+   there, so no lane can overflow for any buffer we could be handed. */
+__attribute__ ((target ("sse2")))
+static uint32_t cksum_fold_sse2 (const void *_data, int len) {
+  const uint8_t *data = _data;
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero, v;
+  uint64_t lanes[2];
+
+  for (; len >= 16; data += 16, len -= 16) {
+    v = _mm_loadu_si128((const __m128i *)data);
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+  }
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+  return cksum_fold_64_from(lanes[0] + lanes[1], data, len);
+}
+
+__attribute__ ((target ("avx2")))
+static uint32_t cksum_fold_avx2 (const void *_data, int len) {
+  const uint8_t *data = _data;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero, v;
+  uint64_t lanes[4];
+
+  for (; len >= 32; data += 32, len -= 32) {
+    v = _mm256_loadu_si256((const __m256i *)data);
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+  return cksum_fold_64_from(lanes[0] + lanes[1] + lanes[2] + lanes[3],
+                            data, len);
+}
+#endif /* x86 */
+
+/* Picks the widest kernel the CPU has on first use. */
+static uint32_t cksum_fold_select (const void *_data, int len);
+static uint32_t (*cksum_fold) (const void *, int) = cksum_fold_select;
+
+static uint32_t cksum_fold_select (const void *_data, int len) {
+  uint32_t (*fold) (const void *, int) = cksum_fold_64;
+#ifdef CKSUM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    fold = cksum_fold_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    fold = cksum_fold_sse2;
+#endif
+  cksum_fold = fold;
+  return fold(_data, len);
+}
+
+/* Forces a kernel by name ("bytes", "64", "sse2" or "avx2"), for timing
+   and cross-checking them.  Returns -1 if the CPU cannot run it. */
+int cksum_use (const char *name) {
+  uint32_t (*fold) (const void *, int) = 0;
+
+  if (strcmp(name, "bytes") == 0)
+    fold = cksum_fold_bytes;
+  else if (strcmp(name, "64") == 0)
+    fold = cksum_fold_64;
+#ifdef CKSUM_X86
+  else if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    fold = cksum_fold_sse2;
+  else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    fold = cksum_fold_avx2;
+#endif
+  if (fold == 0)
+    return -1;
+  cksum_fold = fold;
+  return 0;
+}
+
+uint16_t cksum (const void *_data, int len) {
+  uint32_t sum = cksum_fold(_data, len);
   sum = htons (~sum);
   return sum ? sum : 0xffff;
 }
 
+/* A header whose checksum field is correct sums to 0xffff with the field
+   included, so it can be checked where it lies. */
+int cksum_valid (const void *_data, int len) {
+  return cksum_fold(_data, len) == 0xffff;
+}
+
+/* For checksums put together from parts, e.g. a template's precomputed
+   sum plus the fields patched into it: cksum_sum() is the folded sum of
+   len bytes at an even offset, cksum_add32() adds a 32-bit field in
+   network byte order, and cksum_done() turns the total into what cksum()
+   over the whole would have given. */
+uint32_t cksum_sum (const void *_data, int len) {
+  return cksum_fold(_data, len);
+}
+
+uint32_t cksum_add32 (uint32_t sum, uint32_t nbo) {
+  nbo = ntohl(nbo);
+  return sum + (nbo >> 16) + (nbo & 0xffff);
+}
+
+uint16_t cksum_done (uint32_t sum) {
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = htons (~sum & 0xffff);
+  return sum ? sum : 0xffff;
+}
+
+/* Decrement the TTL and patch ip_sum for the change (RFC 1624, eqn. 3):
+   HC' = ~(~HC + ~m + m') where m is the 16-bit word holding the TTL.
+   Gives the same result as recomputing with cksum(). */
+void ip_ttl_decrement (struct sr_ip_hdr *iphdr) {
+  uint32_t sum;
+  uint16_t old = iphdr->ip_ttl << 8 | iphdr->ip_p;
+
+  iphdr->ip_ttl--;
+  sum = (~ntohs(iphdr->ip_sum) & 0xffff) + (~old & 0xffff) +
+        (iphdr->ip_ttl << 8 | iphdr->ip_p);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = htons (~sum & 0xffff);
+  iphdr->ip_sum = sum ? sum : 0xffff;
+}
+
+/* Every allocation the packet path makes goes through here so that the
+   number of allocations per packet can be read back with
+   sr_pkt_alloc_count().  Forwarding a packet whose next hop is already
+   resolved should not move the counter at all. */
+static unsigned long sr_pkt_allocs;
+
+void *sr_pkt_malloc(unsigned int len) {
+  __atomic_add_fetch(&sr_pkt_allocs, 1, __ATOMIC_RELAXED);
+  return malloc(len);
+}
+
+unsigned long sr_pkt_alloc_count(void) {
+  return __atomic_load_n(&sr_pkt_allocs, __ATOMIC_RELAXED);
+}
+
 
 uint16_t ethertype(uint8_t *buf) {
   sr_ethernet_hdr_t *ehdr = (sr_ethernet_hdr_t *)buf;
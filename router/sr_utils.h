@@ -28,7 +28,19 @@
 #ifndef SR_UTILS_H
 #define SR_UTILS_H
 
+struct sr_ip_hdr;
+
 uint16_t cksum(const void *_data, int len);
+int cksum_valid(const void *_data, int len);
+uint32_t cksum_sum(const void *_data, int len);
+uint32_t cksum_add32(uint32_t sum, uint32_t nbo);
+uint16_t cksum_done(uint32_t sum);
+int cksum_use(const char *name);
+void ip_ttl_decrement(struct sr_ip_hdr *iphdr);
+
+/* heap allocations made on behalf of a packet, see sr_pkt_alloc_count() */
+void *sr_pkt_malloc(unsigned int len);
+unsigned long sr_pkt_alloc_count(void);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
@@ -35,16 +36,59 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#ifdef _LINUX_
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif /* _LINUX_ */
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_arpcache.h"
+#include "sr_workers.h"
+#include "sr_afpacket.h"
+#include "sr_xsk.h"
+#include "sr_capture.h"
+#include "sr_vns_rx.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
+#define SR_TX_FRAMES   64            /* frames per writev(..) */
+#define SR_TX_ARENA    (64 * 1024)   /* bytes for headers and copied frames */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_txq
+ *
+ * Outgoing frames waiting to be written to the server in one writev(..).
+ * Each frame gets its VNS header in the arena.  The frame itself is copied
+ * in behind the header unless it lies in the receive buffer being handled
+ * (the pinned range), which is only released after the queue is flushed.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_txq
+{
+    pthread_mutex_t lock;
+    uint8_t* pin_lo;                 /* frames in [pin_lo, pin_hi) are not copied */
+    uint8_t* pin_hi;
+    unsigned int frames;             /* frames queued */
+    unsigned int niov;
+    unsigned int used;               /* arena bytes in use */
+    struct iovec iov[2 * SR_TX_FRAMES];
+    unsigned long sent;              /* frames written, ever */
+    unsigned long writes;            /* writev(..) calls, ever */
+    uint8_t arena[SR_TX_ARENA];
+};
+
 static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+static int  sr_tx_flush(struct sr_instance* , struct sr_txq* );
+static void sr_tx_pin(struct sr_instance* , uint8_t* , int );
+static int  sr_handle_command(struct sr_instance* , unsigned char* , int , int );
+static int  sr_vns_read(struct sr_instance* , int , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
@@ -121,6 +165,29 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         return -1;
     }
 
+    /* set up the receive buffer, empty for the new connection */
+    if(sr->rxb == 0 &&
+       (sr->rxb = (struct sr_rxbuf*)malloc(sizeof(struct sr_rxbuf))) == 0)
+    {
+        fprintf(stderr,"Error: out of memory (sr_connect_to_server)\n");
+        close(sr->sockfd);
+        return -1;
+    }
+    sr->rxb->head = sr->rxb->tail = 0;
+
+    /* set up transmit batching */
+    if(sr->txq == 0)
+    {
+        if((sr->txq = (struct sr_txq*)malloc(sizeof(struct sr_txq))) == 0)
+        {
+            fprintf(stderr,"Error: out of memory (sr_connect_to_server)\n");
+            close(sr->sockfd);
+            return -1;
+        }
+        memset(sr->txq, 0, offsetof(struct sr_txq, arena));
+        pthread_mutex_init(&(sr->txq->lock), 0);
+    }
+
     /* wait for authentication to be completed (server sends the first message) */
     if(sr_read_from_server_expect(sr, VNS_AUTH_REQUEST)!= 1 ||
        sr_read_from_server_expect(sr, VNS_AUTH_STATUS) != 1)
@@ -331,81 +398,222 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
     return sr_read_from_server_expect(sr, 0);
 }
 
-int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+/*-----------------------------------------------------------------------------
+ * Method: sr_event_loop(..)
+ * Scope: global
+ *
+ * Alternative to looping on sr_read_from_server(..): one thread waits in
+ * epoll on the server socket and a timerfd, handling whatever the server
+ * has sent and running sr_arpcache_tick(..) when the timer fires.  The ARP
+ * cleanup thread is not started in this mode (see sr_init), so the timers
+ * only run here.  The cache itself is still shared with the workers if -w
+ * started any, which look it up and fill it as they handle packets.
+ * Returns like sr_read_from_server(..).
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_event_loop(struct sr_instance* sr /* borrowed */)
 {
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+#ifdef _LINUX_
+    struct epoll_event ev, events[2];
+    struct itimerspec its;
+    uint64_t expirations;
+    unsigned int ms = sr_arpcache_tick_ms(&(sr->cache));
+    int epfd, tfd, n, i, ret = 1;
 
     /* REQUIRES */
     assert(sr);
 
-    /*---------------------------------------------------------------------------
-      Read a command from the server
-      -------------------------------------------------------------------------*/
+    if ( (epfd = epoll_create(2)) < 0 )
+    {
+        perror("epoll_create(..):sr_event_loop");
+        return -1;
+    }
+    if ( (tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0 )
+    {
+        perror("timerfd_create(..):sr_event_loop");
+        close(epfd);
+        return -1;
+    }
+
+    its.it_interval.tv_sec  = ms / 1000;
+    its.it_interval.tv_nsec = (ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(tfd, 0, &its, 0);
 
-    bytes_read = 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sr->sockfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sr->sockfd, &ev);
+    ev.data.fd = tfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
 
-    /* attempt to read the size of the incoming packet */
-    while( bytes_read < 4)
+    while ( ret == 1 )
     {
-        do
-        { /* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read,
-                            4 - bytes_read, 0)) == -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
+        if ( (n = epoll_wait(epfd, events, 2, -1)) < 0 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            perror("epoll_wait(..):sr_event_loop");
+            ret = -1;
+            break;
+        }
 
-                perror("recv(..):sr_client.c::sr_read_from_server");
-                return -1;
+        for ( i = 0; i < n && ret == 1; i++ )
+        {
+            if ( events[i].data.fd == tfd )
+            {
+                /* -- missed ticks are not made up, one pass catches up -- */
+                if ( read(tfd, &expirations, sizeof(expirations)) > 0 )
+                { sr_arpcache_tick(sr); }
             }
-            bytes_read += ret;
-        } while ( errno == EINTR); /* be mindful of signals */
-
+            else
+            { ret = sr_vns_read(sr, 0, 0); }
+        }
     }
 
-    len = ntohl(len);
+    close(tfd);
+    close(epfd);
+    return ret;
+#else
+    fprintf(stderr, "Error: the event loop needs epoll and timerfd (Linux)\n");
+    return -1;
+#endif /* _LINUX_ */
+} /* -- sr_event_loop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_fill(..)
+ * Scope: Local
+ *
+ * Pull whatever the socket has ready into the free end of the buffer, in
+ * one recv(..) unless a signal gets in the way.  A partial command is first
+ * moved to the front if it could not otherwise finish.  Returns the number
+ * of bytes read, 0 if MSG_DONTWAIT was given and nothing was ready, or -1.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_rx_fill(struct sr_instance* sr, struct sr_rxbuf* rb, int flags)
+{
+    unsigned int room = sr_rx_room(rb);
+    int ret;
+
+    do
+    { /* -- just in case SIGALRM breaks recv -- */
+        errno = 0; /* -- hacky glibc workaround -- */
+        ret = recv(sr->sockfd, rb->data + rb->tail, room, flags);
+    } while ( ret == -1 && errno == EINTR ); /* be mindful of signals */
 
-    if ( len > 10000 || len < 0 )
+    if ( ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+    { return 0; }
+    if ( ret == -1 )
     {
-        fprintf(stderr,"Error: command length to large %d\n",len);
-        close(sr->sockfd);
+        perror("recv(..):sr_client.c::sr_read_from_server");
         return -1;
     }
-
-    if((buf = malloc(len)) == 0)
+    if ( ret == 0 )
     {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
+        fprintf(stderr,"Error: connection to server closed\n");
+        close(sr->sockfd);
         return -1;
     }
 
-    /* set first field of command since we've already read it */
-    *((int *)buf) = htonl(len);
+    rb->tail += ret;
+    return ret;
+} /* -- sr_rx_fill -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_read_from_server_expect(..)
+ * Scope: Global
+ *
+ * Read from the server and handle every complete command it has sent so
+ * far, straight out of the receive buffer.  When a particular command is
+ * expected only that one is handled and anything behind it is left for
+ * the next call.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+{
+    return sr_vns_read(sr, expected_cmd, 1);
+}/* -- sr_read_from_server_expect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_read(..)
+ * Scope: Local
+ *
+ * Does the work for sr_read_from_server_expect(..).  Unless wait is set it
+ * reads only what is already there and returns 1 if no command is complete
+ * yet, for the event loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_read(struct sr_instance* sr, int expected_cmd, int wait)
+{
+    struct sr_rxbuf* rb;
+    unsigned char* buf;
+    int len, ret = 1;
+
+    /* REQUIRES */
+    assert(sr);
 
-    bytes_read = 0;
+    assert(sr->rxb);
 
-    /* read the rest of the command */
-    while ( bytes_read < len - 4)
+    rb = sr->rxb;
+
+    /*---------------------------------------------------------------------------
+      Read until at least one whole command is buffered
+      -------------------------------------------------------------------------*/
+
+    if ( !wait && sr_rx_fill(sr, rb, MSG_DONTWAIT) < 0 )
+    { return -1; }
+
+    while ( (len = sr_rx_complete(rb)) == 0 )
     {
-        do
-        {/* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-                fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd);
-                return -1;
-            }
-            bytes_read += ret;
-        } while (errno == EINTR); /* be mindful of signals */
+        if ( !wait )
+        { return 1; }
+        if ( sr_rx_fill(sr, rb, 0) < 0 )
+        { return -1; }
+    }
+    if ( len < 0 )
+    {
+        close(sr->sockfd);
+        return -1;
     }
 
+    /* -- replies sent straight from the buffer need not be copied -- */
+    sr_tx_pin(sr, rb->data + rb->head, rb->tail - rb->head);
+
+    do
+    {
+        buf = rb->data + rb->head;
+        rb->head += len;
+
+        ret = sr_handle_command(sr, buf, len, expected_cmd);
+    } while ( ret == 1 && expected_cmd == 0 &&
+              (len = sr_rx_complete(rb)) > 0 );
+
+    /* -- everything the burst produced goes out before the buffer moves -- */
+    sr_flush_packets(sr);
+    sr_tx_pin(sr, 0, 0);
+
+    return ret;
+}/* -- sr_vns_read -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_command(..)
+ * Scope: Local
+ *
+ * Handle one complete command of len bytes at buf.  The buffer may be
+ * modified.  Returns 1 to carry on, 0 if the server closed the session
+ * and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_handle_command(struct sr_instance* sr, unsigned char* buf,
+                             int len, int expected_cmd)
+{
+    int command, ret;
+
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
     command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
@@ -424,22 +632,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         /* -------------        VNSPACKET     -------------------- */
 
         case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
-
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
+            sr_deliver_packet(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
@@ -454,8 +647,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
 
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -501,10 +692,37 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
-}/* -- sr_read_from_server -- */
+}/* -- sr_handle_command -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_deliver_packet(..)
+ * Scope: Global
+ *
+ * Hand a received frame to the router, whichever backend it came from:
+ * drop ARP requests for other routers, log it, and run sr_handlepacket(..)
+ * here or pass it to a worker.  The frame may be modified.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_deliver_packet(struct sr_instance* sr /* borrowed */,
+                       uint8_t* packet /* lent */,
+                       unsigned int len,
+                       char* interface /* lent */)
+{
+    /* -- check if it is an ARP to another router if so drop   -- */
+    if ( sr_arp_req_not_for_us(sr, packet, len, interface) )
+    { return; }
+
+    /* -- log packet -- */
+    sr_log_packet(sr, packet, len);
+
+    /* -- pass to router, student's code should take over here -- */
+    if ( sr->workers )
+    { sr_workers_dispatch(sr->workers, packet, len, interface); }
+    else
+    { sr_handlepacket(sr, packet, len, interface); }
+} /* -- sr_deliver_packet -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_ether_addrs_match_interface(..)
@@ -564,9 +782,6 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          unsigned int len,
                          const char* iface /* borrowed */)
 {
-    c_packet_header *sr_pkt;
-    unsigned int total_len =  len + (sizeof(c_packet_header));
-
     /* REQUIRES */
     assert(sr);
     assert(buf);
@@ -578,35 +793,212 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
+    /* -- a worker thread leaves the rest to the writer thread -- */
+    if ( sr->workers && sr_workers_tx(sr->workers, buf, len, iface) == 0 )
+    { return 0; }
+
+    return sr_tx_submit(sr, buf, len, iface);
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_submit(..)
+ * Scope: Global
+ *
+ * Log, check and queue a frame for the server.  This is sr_send_packet(..)
+ * less the hand-off to the writer thread, which calls it for the workers.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_tx_submit(struct sr_instance* sr /* borrowed */,
+                 uint8_t* buf /* borrowed */ ,
+                 unsigned int len,
+                 const char* iface /* borrowed */)
+{
+    c_packet_header sr_pkt;
+    struct iovec iov[2];
+    struct sr_txq* q = sr->txq;
+    unsigned int total_len =  len + (sizeof(c_packet_header));
+    unsigned int need;
+    int pinned, ret = 0;
+
+    /* Create header */
+    sr_pkt.mLen  = htonl(total_len);
+    sr_pkt.mType = htonl(VNSPACKET);
+    strncpy(sr_pkt.mInterfaceName,iface,16);
 
     /* -- log packet -- */
     sr_log_packet(sr,buf,len);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
         return -1;
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
-        return -1;
+    if ( sr->afp )
+    { return sr_afpacket_send(sr->afp, buf, len, iface); }
+    if ( sr->xsk )
+    { return sr_xsk_send(sr->xsk, buf, len, iface); }
+
+    if ( q == 0 )
+    {
+        /* -- not connected through sr_connect_to_server, no batching -- */
+        iov[0].iov_base = &sr_pkt;
+        iov[0].iov_len  = sizeof(c_packet_header);
+        iov[1].iov_base = buf;
+        iov[1].iov_len  = len;
+        if( writev(sr->sockfd, iov, 2) < (int)total_len ){
+            fprintf(stderr, "Error writing packet\n");
+            return -1;
+        }
+        return 0;
     }
 
-    free(sr_pkt);
+    pthread_mutex_lock(&(q->lock));
 
-    return 0;
-} /* -- sr_send_packet -- */
+    pinned = (buf >= q->pin_lo && buf + len <= q->pin_hi);
+    need = sizeof(c_packet_header) + (pinned ? 0 : len);
+    if ( q->frames == SR_TX_FRAMES || q->used + need > SR_TX_ARENA )
+    { ret = sr_tx_flush(sr, q); }
+
+    /* -- header, and the frame too unless it stays put until the flush -- */
+    memcpy(q->arena + q->used, &sr_pkt, sizeof(c_packet_header));
+    q->iov[q->niov].iov_base = q->arena + q->used;
+    q->iov[q->niov].iov_len  = need;
+    if ( pinned )
+    {
+        q->niov++;
+        q->iov[q->niov].iov_base = buf;
+        q->iov[q->niov].iov_len  = len;
+    }
+    else
+    { memcpy(q->arena + q->used + sizeof(c_packet_header), buf, len); }
+    q->niov++;
+    q->used += need;
+    q->frames++;
+
+    pthread_mutex_unlock(&(q->lock));
+
+    return ret;
+} /* -- sr_tx_submit -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_flush(..)
+ * Scope: Local
+ *
+ * Write out everything queued on q.  Caller holds q->lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_tx_flush(struct sr_instance* sr, struct sr_txq* q)
+{
+    struct iovec* iov = q->iov;
+    unsigned int niov = q->niov;
+    ssize_t ret;
+    int err = 0;
+
+    while ( niov > 0 )
+    {
+        if ( (ret = writev(sr->sockfd, iov, niov)) < 0 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            fprintf(stderr, "Error writing packet\n");
+            err = -1;
+            break;
+        }
+        q->writes++;
+
+        /* -- a short write leaves the rest for another go -- */
+        while ( niov > 0 && (size_t)ret >= iov->iov_len )
+        {
+            ret -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if ( niov > 0 )
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    if ( err == 0 )
+    { q->sent += q->frames; }
+    q->frames = 0;
+    q->niov = 0;
+    q->used = 0;
+    return err;
+} /* -- sr_tx_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flush_packets(..)
+ * Scope: Global
+ *
+ * Send everything sr_send_packet(..) has queued.  The receive loop calls
+ * this after each command and the ARP thread after each sweep, so a frame
+ * never waits longer than the work that produced it.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_flush_packets(struct sr_instance* sr /* borrowed */)
+{
+    struct sr_txq* q = sr->txq;
+    int ret = 0;
+
+    if ( sr->afp )
+    { return sr_afpacket_flush(sr->afp); }
+    if ( sr->xsk )
+    { return sr_xsk_flush(sr->xsk); }
+
+    if ( q == 0 )
+    { return 0; }
+
+    pthread_mutex_lock(&(q->lock));
+    if ( q->frames > 0 )
+    { ret = sr_tx_flush(sr, q); }
+    pthread_mutex_unlock(&(q->lock));
+
+    return ret;
+} /* -- sr_flush_packets -- */
+
+/* frames in [buf, buf+len) stay valid until the next flush */
+static void sr_tx_pin(struct sr_instance* sr, uint8_t* buf, int len)
+{
+    struct sr_txq* q = sr->txq;
+
+    if ( q == 0 )
+    { return; }
+
+    pthread_mutex_lock(&(q->lock));
+    q->pin_lo = buf;
+    q->pin_hi = buf ? buf + len : 0;
+    pthread_mutex_unlock(&(q->lock));
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_tx_counters(..)
+ * Scope: Global
+ *
+ * Frames written and writev(..) calls made so far; frames - writes is the
+ * number of syscalls batching has saved.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_tx_counters(struct sr_instance* sr, unsigned long* frames,
+                    unsigned long* writes)
+{
+    struct sr_txq* q = sr->txq;
+
+    *frames = 0;
+    *writes = 0;
+    if ( q == 0 )
+    { return; }
+
+    pthread_mutex_lock(&(q->lock));
+    *frames = q->sent;
+    *writes = q->writes;
+    pthread_mutex_unlock(&(q->lock));
+} /* -- sr_tx_counters -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -625,6 +1017,12 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
     if(!sr->logfile)
     {return; }
 
+    if(sr->capture)
+    {
+        sr_capture_put(sr->capture, buf, len);
+        return;
+    }
+
     size = min(PACKET_DUMP_SIZE, len);
 
     gettimeofday(&h.ts, 0);
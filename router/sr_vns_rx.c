@@ -0,0 +1,79 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_rx.c
+ *
+ * Description:
+ *
+ * Framing of the commands in the VNS receive buffer, see sr_vns_rx.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_vns_rx.h"
+#include "vnscommand.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_complete(..)
+ * Scope: Global
+ *
+ * Length of the first buffered command if all of it has arrived, 0 if
+ * more is needed, -1 if the length field is bogus.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_rx_complete(struct sr_rxbuf* rb)
+{
+    uint32_t len;
+
+    if ( rb->tail - rb->head < 4 )
+    { return 0; }
+
+    memcpy(&len, rb->data + rb->head, 4);
+    len = ntohl(len);
+
+    if ( len > SR_VNS_MAX_CMD )
+    {
+        fprintf(stderr,"Error: command length too large %u\n",(unsigned int)len);
+        return -1;
+    }
+    if ( len < sizeof(c_base) )
+    {
+        fprintf(stderr,"Error: command length too small %u\n",(unsigned int)len);
+        return -1;
+    }
+
+    return (rb->tail - rb->head >= len) ? (int)len : 0;
+} /* -- sr_rx_complete -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_room(..)
+ * Scope: Global
+ *
+ * Make room to read into and return how much there is at data + tail.  A
+ * partial command is first moved to the front if it could not otherwise
+ * finish.
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_rx_room(struct sr_rxbuf* rb)
+{
+    if ( rb->head == rb->tail )
+    { rb->head = rb->tail = 0; }
+    else if ( SR_RX_BUF - rb->head < SR_VNS_MAX_CMD )
+    {
+        memmove(rb->data, rb->data + rb->head, rb->tail - rb->head);
+        rb->tail -= rb->head;
+        rb->head = 0;
+    }
+    return SR_RX_BUF - rb->tail;
+} /* -- sr_rx_room -- */
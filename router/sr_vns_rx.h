@@ -0,0 +1,39 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_rx.h
+ *
+ * Description:
+ *
+ * The receive buffer for commands from the VNS server.  Bytes are read
+ * into the free end in as large a piece as the socket has ready, and each
+ * command is handled where it lies once all of it has arrived; a partial
+ * one waits for the rest.  Nothing here touches the socket, so the framing
+ * can be driven from memory as well (sr_bench -t vns).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_VNS_RX_H
+#define sr_VNS_RX_H
+
+#define SR_VNS_MAX_CMD 10000   /* largest command the server may send */
+
+#define SR_RX_BUF      (256 * 1024)  /* receive buffer, many commands deep */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rxbuf
+ *
+ * Bytes read from the server.  Commands are handled where they lie between
+ * head and tail; a partial one waits there for the rest.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rxbuf
+{
+    unsigned int head;               /* start of the first unhandled command */
+    unsigned int tail;               /* end of the data read so far */
+    unsigned char data[SR_RX_BUF];
+};
+
+int sr_rx_complete(struct sr_rxbuf* rb);
+unsigned int sr_rx_room(struct sr_rxbuf* rb);
+
+#endif  /* --  sr_VNS_RX_H -- */
@@ -0,0 +1,474 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workers.c
+ *
+ * Description:
+ *
+ * Worker threads and the writer thread, see sr_workers.h.  Frames travel
+ * in pool buffers: the reader fills one per received frame and the worker
+ * returns it when done, and a worker fills one per frame it sends, which
+ * the writer returns once the frame is queued for the socket.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <netinet/in.h>
+
+#include "sr_workers.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pool.h"
+
+#define SR_RING_MASK    (SR_RING_SZ - 1)
+#define SR_WORKER_SPIN  128     /* empty polls before going to sleep */
+
+/* the worker running on this thread, if any */
+static __thread struct sr_worker* sr_worker_self;
+
+/* producer side; returns -1 if the ring is full */
+static int sr_ring_push(struct sr_ring* r, void* p)
+{
+    unsigned int t = r->tail;
+
+    if ( t - __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE) == SR_RING_SZ )
+    { return -1; }
+    r->slot[t & SR_RING_MASK] = p;
+    __atomic_store_n(&(r->tail), t + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* consumer side; returns 0 if the ring is empty */
+static void* sr_ring_pop(struct sr_ring* r)
+{
+    unsigned int h = r->head;
+    void* p;
+
+    if ( h == __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE) )
+    { return 0; }
+    p = r->slot[h & SR_RING_MASK];
+    __atomic_store_n(&(r->head), h + 1, __ATOMIC_RELEASE);
+    return p;
+}
+
+static int sr_ring_empty(struct sr_ring* r)
+{
+    return r->head == __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+}
+
+void sr_bell_init(struct sr_bell* b)
+{
+    pthread_mutex_init(&(b->lock), 0);
+    pthread_cond_init(&(b->cond), 0);
+    b->sleeping = 0;
+}
+
+/* Called after pushing.  Either the consumer sees the new frame when it
+   looks one last time before sleeping, or we see that it is asleep. */
+void sr_bell_ring(struct sr_bell* b)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ( __atomic_load_n(&(b->sleeping), __ATOMIC_RELAXED) )
+    {
+        pthread_mutex_lock(&(b->lock));
+        pthread_cond_signal(&(b->cond));
+        pthread_mutex_unlock(&(b->lock));
+    }
+}
+
+/* Announce that we are about to sleep; the caller then checks its rings
+   once more and calls sr_bell_sleep(..) with the answer. */
+void sr_bell_prepare(struct sr_bell* b)
+{
+    pthread_mutex_lock(&(b->lock));
+    __atomic_store_n(&(b->sleeping), 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void sr_bell_sleep(struct sr_bell* b, int idle)
+{
+    if ( idle )
+    { pthread_cond_wait(&(b->cond), &(b->lock)); }
+    __atomic_store_n(&(b->sleeping), 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&(b->lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_flow(..)
+ * Scope:  Global
+ *
+ * Flow hash of an Ethernet frame.  TCP and UDP are hashed on the 5-tuple,
+ * other IP traffic and IP fragments on the addresses and protocol alone
+ * (only the first fragment carries the ports), ARP on the two addresses.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_workers_flow(uint8_t* packet, unsigned int len)
+{
+    sr_ethernet_hdr_t* ethr = (sr_ethernet_hdr_t*)packet;
+    sr_ip_hdr_t* ip;
+    sr_arp_hdr_t* arp;
+    uint32_t h = 0, ports = 0;
+    unsigned int hl;
+
+    if ( len < sizeof(sr_ethernet_hdr_t) )
+    { return 0; }
+
+    if ( ethr->ether_type == htons(ethertype_ip) &&
+         len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) )
+    {
+        ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+        hl = ip->ip_hl * 4;
+        if ( (ip->ip_p == ip_protocol_tcp || ip->ip_p == ip_protocol_udp) &&
+             (ntohs(ip->ip_off) & (IP_MF | IP_OFFMASK)) == 0 &&
+             len >= sizeof(sr_ethernet_hdr_t) + hl + 4 )
+        { memcpy(&ports, packet + sizeof(sr_ethernet_hdr_t) + hl, 4); }
+        h = (ip->ip_src * 0x9e3779b1U) ^ ip->ip_dst;
+        h = (h * 0x85ebca6bU) ^ ports ^ ip->ip_p;
+    }
+    else if ( ethr->ether_type == htons(ethertype_arp) &&
+              len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t) )
+    {
+        arp = (sr_arp_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+        h = arp->ar_sip ^ arp->ar_tip;
+    }
+
+    /* -- murmur3 finaliser, so every bit reaches the top ones -- */
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+} /* -- sr_workers_flow -- */
+
+/* copy a frame into a pool buffer behind its sr_work header */
+static struct sr_work* sr_work_new(struct sr_instance* sr, uint8_t* buf,
+                                   unsigned int len, const char* iface)
+{
+    struct sr_work* work;
+
+    work = (struct sr_work*)sr_pool_get(sr->pool, sizeof(struct sr_work) + len);
+    work->len = len;
+    strncpy(work->iface, iface, sr_IFACE_NAMELEN);
+    memcpy(work + 1, buf, len);
+    return work;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_dispatch(..)
+ * Scope:  Global
+ *
+ * Hand a received frame to the worker for its flow.  Called by the one
+ * thread reading the server.  Waits while that worker's ring is full, so
+ * a slow worker holds up reading rather than losing or reordering frames.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_dispatch(struct sr_workers* ws, uint8_t* packet,
+                         unsigned int len, const char* iface)
+{
+    struct sr_worker* w;
+    struct sr_work* work;
+
+    w = &(ws->w[((uint64_t)sr_workers_flow(packet, len) * ws->n) >> 32]);
+    work = sr_work_new(ws->sr, packet, len, iface);
+
+    while ( sr_ring_push(&(w->rx), work) < 0 )
+    {
+        sr_bell_ring(&(w->bell));
+        sched_yield();
+    }
+    sr_bell_ring(&(w->bell));
+} /* -- sr_workers_dispatch -- */
+
+/* pass a frame to the writer; only w's own thread may call this */
+static void sr_worker_push_tx(struct sr_worker* w, struct sr_work* work)
+{
+    while ( sr_ring_push(&(w->tx), work) < 0 )
+    {
+        sr_bell_ring(&(w->ws->bell));
+        sched_yield();
+    }
+    sr_bell_ring(&(w->ws->bell));
+}
+
+/* pass on what other workers handed back to w, in the order they did */
+static void sr_worker_send_back(struct sr_worker* w)
+{
+    struct sr_work* work;
+    struct sr_work* next;
+
+    if ( __atomic_load_n(&(w->back), __ATOMIC_ACQUIRE) == 0 )
+    { return; }
+
+    pthread_mutex_lock(&(w->back_lock));
+    work = w->back;
+    __atomic_store_n(&(w->back), 0, __ATOMIC_RELAXED);
+    w->back_tail = &(w->back);
+    pthread_mutex_unlock(&(w->back_lock));
+
+    for ( ; work; work = next )
+    {
+        next = work->next;
+        sr_worker_push_tx(w, work);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_tx(..)
+ * Scope:  Global
+ *
+ * Called by sr_send_packet(..).  On a worker thread the frame is copied
+ * and passed to the writer, and 0 returned; anywhere else returns 1 and
+ * the caller sends the frame itself.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workers_tx(struct sr_workers* ws, uint8_t* buf, unsigned int len,
+                  const char* iface)
+{
+    struct sr_worker* w = sr_worker_self;
+
+    if ( w == 0 || w->ws != ws )
+    { return 1; }
+
+    /* -- older frames of our flows, released by another worker -- */
+    sr_worker_send_back(w);
+    sr_worker_push_tx(w, sr_work_new(ws->sr, buf, len, iface));
+    return 0;
+} /* -- sr_workers_tx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_handback(..)
+ * Scope:  Global
+ *
+ * Send a frame through the worker its flow hashes to, as that worker
+ * would have.  Called by sr_handlearp(..) for the packets an ARP reply
+ * releases, before the reply's entry is visible, so the flow's worker
+ * sends them before it can send anything newer of the flow.  Returns 0
+ * if the frame was handed over, 1 if the caller should send it itself:
+ * off a worker thread, or when the flow is the caller's own.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workers_handback(struct sr_workers* ws, uint8_t* buf, unsigned int len,
+                        const char* iface)
+{
+    struct sr_worker* self = sr_worker_self;
+    struct sr_worker* w;
+    struct sr_work* work;
+
+    if ( self == 0 || self->ws != ws )
+    { return 1; }
+    w = &(ws->w[((uint64_t)sr_workers_flow(buf, len) * ws->n) >> 32]);
+    if ( w == self )
+    { return 1; }
+
+    work = sr_work_new(ws->sr, buf, len, iface);
+    work->next = 0;
+    pthread_mutex_lock(&(w->back_lock));
+    if ( w->back == 0 )
+    { __atomic_store_n(&(w->back), work, __ATOMIC_RELEASE); }
+    else
+    { *(w->back_tail) = work; }
+    w->back_tail = &(work->next);
+    pthread_mutex_unlock(&(w->back_lock));
+    sr_bell_ring(&(w->bell));
+    return 0;
+} /* -- sr_workers_handback -- */
+
+static void* sr_worker_main(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_instance* sr = w->ws->sr;
+    struct sr_work* work;
+    int spin = 0;
+
+    sr_worker_self = w;
+
+    while ( 1 )
+    {
+        sr_worker_send_back(w);
+        if ( (work = (struct sr_work*)sr_ring_pop(&(w->rx))) != 0 )
+        {
+            sr_handlepacket(sr, (uint8_t*)(work + 1), work->len, work->iface);
+            sr_pool_put(sr->pool, work);
+            w->packets++;
+            spin = 0;
+            continue;
+        }
+
+        if ( __atomic_load_n(&(w->ws->stop), __ATOMIC_ACQUIRE) )
+        { break; }
+        if ( spin++ < SR_WORKER_SPIN )
+        {
+            sched_yield();
+            continue;
+        }
+
+        sr_bell_prepare(&(w->bell));
+        sr_bell_sleep(&(w->bell), sr_ring_empty(&(w->rx)) &&
+                      __atomic_load_n(&(w->back), __ATOMIC_RELAXED) == 0 &&
+                      !__atomic_load_n(&(w->ws->stop), __ATOMIC_RELAXED));
+        spin = 0;
+    }
+
+    return 0;
+}
+
+/* One pass over every worker's transmit ring.  Returns frames sent. */
+static unsigned int sr_writer_drain(struct sr_workers* ws)
+{
+    struct sr_work* work;
+    unsigned int i, sent = 0;
+
+    for ( i = 0; i < ws->n; i++ )
+    {
+        while ( (work = (struct sr_work*)sr_ring_pop(&(ws->w[i].tx))) != 0 )
+        {
+            sr_tx_submit(ws->sr, (uint8_t*)(work + 1), work->len, work->iface);
+            sr_pool_put(ws->sr->pool, work);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+static int sr_writer_idle(struct sr_workers* ws)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ws->n; i++ )
+    {
+        if ( !sr_ring_empty(&(ws->w[i].tx)) )
+        { return 0; }
+    }
+    return 1;
+}
+
+static void* sr_writer_main(void* arg)
+{
+    struct sr_workers* ws = (struct sr_workers*)arg;
+    int spin = 0;
+
+    while ( 1 )
+    {
+        if ( sr_writer_drain(ws) > 0 )
+        {
+            /* -- one writev(..) for everything the pass picked up -- */
+            sr_flush_packets(ws->sr);
+            spin = 0;
+            continue;
+        }
+
+        if ( __atomic_load_n(&(ws->done), __ATOMIC_ACQUIRE) )
+        { break; }
+        if ( spin++ < SR_WORKER_SPIN )
+        {
+            sched_yield();
+            continue;
+        }
+
+        sr_bell_prepare(&(ws->bell));
+        sr_bell_sleep(&(ws->bell), sr_writer_idle(ws) &&
+                      !__atomic_load_n(&(ws->done), __ATOMIC_RELAXED));
+        spin = 0;
+    }
+
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_start(..)
+ * Scope:  Global
+ *
+ * Start n workers and the writer.  Returns 0 if n is out of range or a
+ * thread could not be started.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_workers* sr_workers_start(struct sr_instance* sr, unsigned int n)
+{
+    struct sr_workers* ws;
+    unsigned int i;
+
+    if ( n == 0 || n > SR_WORKERS_MAX )
+    {
+        fprintf(stderr, "Error: between 1 and %d workers\n", SR_WORKERS_MAX);
+        return 0;
+    }
+
+    ws = (struct sr_workers*)calloc(1, sizeof(struct sr_workers));
+    assert(ws);
+    ws->w = (struct sr_worker*)calloc(n, sizeof(struct sr_worker));
+    assert(ws->w);
+    ws->sr = sr;
+    sr_bell_init(&(ws->bell));
+
+    for ( i = 0; i < n; i++ )
+    {
+        ws->w[i].ws = ws;
+        sr_bell_init(&(ws->w[i].bell));
+        pthread_mutex_init(&(ws->w[i].back_lock), 0);
+        ws->w[i].back_tail = &(ws->w[i].back);
+        if ( pthread_create(&(ws->w[i].thread), 0, sr_worker_main,
+                            &(ws->w[i])) != 0 )
+        { break; }
+        ws->n = i + 1;
+    }
+
+    if ( ws->n < n || pthread_create(&(ws->writer), 0, sr_writer_main, ws) != 0 )
+    {
+        perror("pthread_create(..):sr_workers_start");
+        __atomic_store_n(&(ws->stop), 1, __ATOMIC_RELEASE);
+        for ( i = 0; i < ws->n; i++ )
+        {
+            sr_bell_ring(&(ws->w[i].bell));
+            pthread_join(ws->w[i].thread, 0);
+        }
+        free(ws->w);
+        free(ws);
+        return 0;
+    }
+
+    return ws;
+} /* -- sr_workers_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_stop(..)
+ * Scope:  Global
+ *
+ * Let the workers finish the frames already handed to them, send what
+ * they produced and stop all the threads.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_stop(struct sr_workers* ws)
+{
+    unsigned int i;
+
+    if ( ws == 0 )
+    { return; }
+
+    __atomic_store_n(&(ws->stop), 1, __ATOMIC_RELEASE);
+    for ( i = 0; i < ws->n; i++ )
+    {
+        sr_bell_ring(&(ws->w[i].bell));
+        pthread_join(ws->w[i].thread, 0);
+    }
+
+    /* -- frames handed back to a worker that had already stopped; its
+          transmit ring has no other producer now -- */
+    for ( i = 0; i < ws->n; i++ )
+    { sr_worker_send_back(&(ws->w[i])); }
+
+    __atomic_store_n(&(ws->done), 1, __ATOMIC_RELEASE);
+    sr_bell_ring(&(ws->bell));
+    pthread_join(ws->writer, 0);
+
+    free(ws->w);
+    free(ws);
+} /* -- sr_workers_stop -- */
@@ -0,0 +1,121 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_workers.h
+ *
+ * Description:
+ *
+ * Optional forwarding pipeline.  The thread reading the server only copies
+ * each frame into a pool buffer and hands it to one of N worker threads,
+ * picked by hashing the flow (the TCP/UDP 5-tuple, or the IP addresses for
+ * anything else), so the packets of one flow are always handled in order by
+ * the same worker.  Workers run sr_handlepacket(..); the frames they send
+ * are passed on to a single writer thread, which is the only one of them to
+ * touch the socket.
+ *
+ * Every hop is a single-producer single-consumer ring, so no lock is taken
+ * on the packet path.  A thread that finds its rings empty for a while
+ * sleeps until a producer rings its doorbell.
+ *
+ * The writer takes frames from the rings one after another, so two frames
+ * of one flow only keep their order if they go through the same worker.
+ * An ARP reply releases packets queued by many flows at once; the worker
+ * handling it hands each back to the worker of its flow, which sends them
+ * ahead of anything it sends itself (sr_workers_handback(..)).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_WORKERS_H
+#define sr_WORKERS_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_if.h"
+
+#define SR_WORKERS_MAX  64
+#define SR_RING_SZ      512     /* frames per ring, a power of two */
+#define SR_CACHELINE    64
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ring
+ *
+ * Single-producer single-consumer ring of pointers.  head is only written
+ * by the consumer and tail only by the producer; they sit on separate cache
+ * lines so the two sides do not fight over one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ring
+{
+    unsigned int head;
+    char pad0[SR_CACHELINE - sizeof(unsigned int)];
+    unsigned int tail;
+    char pad1[SR_CACHELINE - sizeof(unsigned int)];
+    void* slot[SR_RING_SZ];
+};
+
+/* wakes a consumer sleeping on empty rings */
+struct sr_bell
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleeping;
+};
+
+/* a frame in transit, at the front of its pool buffer */
+struct sr_work
+{
+    struct sr_work* next;       /* on a worker's handed back list */
+    unsigned int len;
+    char iface[sr_IFACE_NAMELEN];
+};
+
+struct sr_worker
+{
+    struct sr_workers* ws;
+    pthread_t thread;
+    struct sr_ring rx;          /* reader -> worker */
+    struct sr_ring tx;          /* worker -> writer */
+    struct sr_bell bell;
+    unsigned long packets;      /* handled */
+    pthread_mutex_t back_lock;
+    struct sr_work* back;       /* handed back by other workers, oldest first */
+    struct sr_work** back_tail;
+};
+
+struct sr_workers
+{
+    struct sr_instance* sr;
+    unsigned int n;
+    struct sr_worker* w;
+    pthread_t writer;
+    struct sr_bell bell;        /* the writer's */
+    int stop;                   /* workers finish what is queued and exit */
+    int done;                   /* then the writer does */
+};
+
+struct sr_workers* sr_workers_start(struct sr_instance* , unsigned int n);
+void sr_workers_stop(struct sr_workers* );
+void sr_workers_dispatch(struct sr_workers* , uint8_t* packet,
+                         unsigned int len, const char* iface);
+int sr_workers_tx(struct sr_workers* , uint8_t* buf, unsigned int len,
+                  const char* iface);
+int sr_workers_handback(struct sr_workers* , uint8_t* buf, unsigned int len,
+                        const char* iface);
+unsigned int sr_workers_flow(uint8_t* packet, unsigned int len);
+
+/* also used by the capture writer, see sr_capture.h */
+void sr_bell_init(struct sr_bell* );
+void sr_bell_ring(struct sr_bell* );
+void sr_bell_prepare(struct sr_bell* );
+void sr_bell_sleep(struct sr_bell* , int idle);
+
+#endif  /* --  sr_WORKERS_H -- */
@@ -0,0 +1,696 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_xsk.c
+ *
+ * Description:
+ *
+ * AF_XDP backend, see sr_xsk.h.  UMEM frames are owned by exactly one of:
+ * the free stack, a fill ring, the kernel (received or being sent), the
+ * loop while it hands a received frame to the router, or a transmit ring.
+ * A received frame that the router sends back out, in place, moves
+ * straight to that interface's transmit ring; any other returns to the
+ * free stack once handled.  Transmitted frames come back through the
+ * completion rings.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef _LINUX_
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <net/if.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#endif /* _LINUX_ */
+
+#include "sr_xsk.h"
+#include "sr_afpacket.h"
+#include "sr_router.h"
+#include "sr_if.h"
+
+#ifdef _LINUX_
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define SR_XSK_NONE     ((uint64_t)-1)
+#define SR_XSK_CHUNK(a) ((a) & ~(uint64_t)(SR_XSK_FRAME_SZ - 1))
+
+static int sr_bpf(int cmd, union bpf_attr* attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static struct bpf_insn sr_bpf_insn(uint8_t code, uint8_t dst, uint8_t src,
+                                   int16_t off, int32_t imm)
+{
+    struct bpf_insn insn;
+
+    memset(&insn, 0, sizeof(insn));
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    return insn;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_attach(..)
+ * Scope:  Local
+ *
+ * Put l's socket in a one-entry XSKMAP and attach, in SKB mode,
+ *
+ *     return bpf_redirect_map(&map, ctx->rx_queue_index, XDP_PASS);
+ *
+ * which hands every frame on queue 0 to the socket.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xsk_attach(struct sr_xsk_link* l)
+{
+    union bpf_attr attr;
+    struct bpf_insn prog[6];
+    static char log[4096];
+    uint32_t key = 0;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 1;
+    if ( (l->map_fd = sr_bpf(BPF_MAP_CREATE, &attr)) < 0 )
+    {
+        perror("bpf(BPF_MAP_CREATE):sr_xsk_open");
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = l->map_fd;
+    attr.key = (uint64_t)(unsigned long)&key;
+    attr.value = (uint64_t)(unsigned long)&(l->fd);
+    attr.flags = BPF_ANY;
+    if ( sr_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0 )
+    {
+        perror("bpf(BPF_MAP_UPDATE_ELEM):sr_xsk_open");
+        return -1;
+    }
+
+    prog[0] = sr_bpf_insn(BPF_LDX | BPF_MEM | BPF_W, 2, 1,
+                          offsetof(struct xdp_md, rx_queue_index), 0);
+    prog[1] = sr_bpf_insn(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD,
+                          0, l->map_fd);
+    prog[2] = sr_bpf_insn(0, 0, 0, 0, 0);
+    prog[3] = sr_bpf_insn(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS);
+    prog[4] = sr_bpf_insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    prog[5] = sr_bpf_insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(unsigned long)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uint64_t)(unsigned long)"GPL";
+    attr.log_buf = (uint64_t)(unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    if ( (l->prog_fd = sr_bpf(BPF_PROG_LOAD, &attr)) < 0 )
+    {
+        perror("bpf(BPF_PROG_LOAD):sr_xsk_open");
+        fprintf(stderr, "%s\n", log);
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = l->prog_fd;
+    attr.link_create.target_ifindex = l->ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    if ( (l->bpf_link_fd = sr_bpf(BPF_LINK_CREATE, &attr)) < 0 )
+    {
+        perror("bpf(BPF_LINK_CREATE):sr_xsk_open");
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_xsk_attach -- */
+
+static int sr_xsk_ring_map(int fd, struct sr_xsk_ring* r,
+                           const struct xdp_ring_offset* off, size_t entry,
+                           off_t pgoff)
+{
+    r->map_len = off->desc + SR_XSK_RING_SZ * entry;
+    r->map = mmap(0, r->map_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if ( r->map == MAP_FAILED )
+    {
+        r->map = 0;
+        perror("mmap(..):sr_xsk_open");
+        return -1;
+    }
+    r->producer = (uint32_t*)((uint8_t*)r->map + off->producer);
+    r->consumer = (uint32_t*)((uint8_t*)r->map + off->consumer);
+    r->desc = (uint8_t*)r->map + off->desc;
+    r->mask = SR_XSK_RING_SZ - 1;
+    return 0;
+}
+
+/* entries a consumer may take */
+static uint32_t sr_xsk_ring_ready(struct sr_xsk_ring* r)
+{
+    return __atomic_load_n(r->producer, __ATOMIC_ACQUIRE) - *(r->consumer);
+}
+
+/* entries a producer may fill */
+static uint32_t sr_xsk_ring_space(struct sr_xsk_ring* r)
+{
+    return SR_XSK_RING_SZ -
+           (*(r->producer) - __atomic_load_n(r->consumer, __ATOMIC_ACQUIRE));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_link_open(..)
+ * Scope:  Local
+ *
+ * Create link i's socket and rings and bind it to queue 0.  The first
+ * socket registers the UMEM; the others share it.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xsk_link_open(struct sr_xsk* x, unsigned int i)
+{
+    struct sr_xsk_link* l = &(x->link[i]);
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen = sizeof(off);
+    int entries = SR_XSK_RING_SZ;
+
+    if ( i == 0 )
+    {
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = (uint64_t)(unsigned long)x->umem;
+        reg.len = x->umem_len;
+        reg.chunk_size = SR_XSK_FRAME_SZ;
+        reg.headroom = 0;
+        if ( setsockopt(l->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 )
+        {
+            perror("setsockopt(XDP_UMEM_REG):sr_xsk_open");
+            return -1;
+        }
+    }
+
+    /* -- each socket has its own fill and completion rings -- */
+    if ( setsockopt(l->fd, SOL_XDP, XDP_UMEM_FILL_RING, &entries, sizeof(entries)) < 0 ||
+         setsockopt(l->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &entries, sizeof(entries)) < 0 ||
+         setsockopt(l->fd, SOL_XDP, XDP_RX_RING, &entries, sizeof(entries)) < 0 ||
+         setsockopt(l->fd, SOL_XDP, XDP_TX_RING, &entries, sizeof(entries)) < 0 )
+    {
+        perror("setsockopt(XDP_*_RING):sr_xsk_open");
+        return -1;
+    }
+    if ( getsockopt(l->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0 )
+    {
+        perror("getsockopt(XDP_MMAP_OFFSETS):sr_xsk_open");
+        return -1;
+    }
+
+    if ( sr_xsk_ring_map(l->fd, &(l->rx), &(off.rx), sizeof(struct xdp_desc),
+                         XDP_PGOFF_RX_RING) < 0 ||
+         sr_xsk_ring_map(l->fd, &(l->tx), &(off.tx), sizeof(struct xdp_desc),
+                         XDP_PGOFF_TX_RING) < 0 ||
+         sr_xsk_ring_map(l->fd, &(l->fill), &(off.fr), sizeof(uint64_t),
+                         XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+         sr_xsk_ring_map(l->fd, &(l->comp), &(off.cr), sizeof(uint64_t),
+                         XDP_UMEM_PGOFF_COMPLETION_RING) < 0 )
+    { return -1; }
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = l->ifindex;
+    sxdp.sxdp_queue_id = 0;
+    if ( i == 0 )
+    { sxdp.sxdp_flags = XDP_COPY; }
+    else
+    {
+        sxdp.sxdp_flags = XDP_SHARED_UMEM;
+        sxdp.sxdp_shared_umem_fd = x->link[0].fd;
+    }
+    if ( bind(l->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0 )
+    {
+        perror("bind(..):sr_xsk_open");
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_xsk_link_open -- */
+
+/* Move completed transmit frames back to the free stack.  Caller holds
+   x->lock. */
+static void sr_xsk_reap(struct sr_xsk* x)
+{
+    struct sr_xsk_link* l;
+    uint64_t* comp;
+    uint32_t n, cons, k;
+    unsigned int i;
+
+    for ( i = 0; i < x->n; i++ )
+    {
+        l = &(x->link[i]);
+        if ( (n = sr_xsk_ring_ready(&(l->comp))) == 0 )
+        { continue; }
+        comp = (uint64_t*)l->comp.desc;
+        cons = *(l->comp.consumer);
+        for ( k = 0; k < n; k++ )
+        { x->free[x->nfree++] = SR_XSK_CHUNK(comp[(cons + k) & l->comp.mask]); }
+        __atomic_store_n(l->comp.consumer, cons + n, __ATOMIC_RELEASE);
+        l->tx_inflight -= n;
+    }
+}
+
+/* Give l's fill ring as many free frames as it has room for.  Caller
+   holds x->lock. */
+static void sr_xsk_refill(struct sr_xsk* x, struct sr_xsk_link* l)
+{
+    uint64_t* fill = (uint64_t*)l->fill.desc;
+    uint32_t n, prod, k;
+
+    n = sr_xsk_ring_space(&(l->fill));
+    if ( n > x->nfree )
+    { n = x->nfree; }
+    if ( n == 0 )
+    { return; }
+
+    prod = *(l->fill.producer);
+    for ( k = 0; k < n; k++ )
+    { fill[(prod + k) & l->fill.mask] = x->free[--x->nfree]; }
+    __atomic_store_n(l->fill.producer, prod + n, __ATOMIC_RELEASE);
+}
+
+/* start the kernel on the queued frames; caller holds x->lock */
+static void sr_xsk_kick(struct sr_xsk_link* l)
+{
+    l->tx_pending = 0;
+    if ( sendto(l->fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0 &&
+         errno != EAGAIN && errno != EBUSY && errno != ENOBUFS &&
+         errno != ENETDOWN && errno != EINTR )
+    { perror("sendto(..):sr_xsk"); }
+}
+
+static void sr_xsk_link_close(struct sr_xsk_link* l)
+{
+    if ( l->bpf_link_fd >= 0 )
+    { close(l->bpf_link_fd); }
+    if ( l->prog_fd >= 0 )
+    { close(l->prog_fd); }
+    if ( l->map_fd >= 0 )
+    { close(l->map_fd); }
+    if ( l->rx.map )
+    { munmap(l->rx.map, l->rx.map_len); }
+    if ( l->tx.map )
+    { munmap(l->tx.map, l->tx.map_len); }
+    if ( l->fill.map )
+    { munmap(l->fill.map, l->fill.map_len); }
+    if ( l->comp.map )
+    { munmap(l->comp.map, l->comp.map_len); }
+    if ( l->fd >= 0 )
+    { close(l->fd); }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_open(..)
+ * Scope:  Global
+ *
+ * Bind every interface in map, add it to the router and start
+ * redirecting its traffic.  Returns 0 on any error, having said what it
+ * was.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_xsk* sr_xsk_open(struct sr_instance* sr, const char* map)
+{
+    struct sr_xsk* x;
+    struct sr_xsk_link* l;
+    struct rlimit rl = { RLIM_INFINITY, RLIM_INFINITY };
+    unsigned char mac[SR_XSK_MAX_LINKS][ETHER_ADDR_LEN];
+    uint32_t ip[SR_XSK_MAX_LINKS];
+    uint32_t addr;
+    char name[sr_IFACE_NAMELEN];
+    char dev[sr_IFACE_NAMELEN];
+    const char* p = map;
+    unsigned int i, frames;
+    int ret, fd;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(map);
+
+    x = (struct sr_xsk*)calloc(1, sizeof(struct sr_xsk));
+    assert(x);
+    pthread_mutex_init(&(x->lock), 0);
+    x->rx_cur = SR_XSK_NONE;
+
+    /* -- older kernels charge the UMEM and maps to RLIMIT_MEMLOCK -- */
+    setrlimit(RLIMIT_MEMLOCK, &rl);
+
+    while ( (ret = sr_ifmap_parse(&p, name, dev, &addr)) > 0 )
+    {
+        if ( x->n == SR_XSK_MAX_LINKS )
+        {
+            fprintf(stderr, "Error: at most %d interfaces\n", SR_XSK_MAX_LINKS);
+            ret = -1;
+            break;
+        }
+        ip[x->n] = addr;
+        l = &(x->link[x->n++]);
+        l->map_fd = l->prog_fd = l->bpf_link_fd = -1;
+        strcpy(l->name, name);
+        strcpy(l->dev, dev);
+        if ( (l->fd = socket(AF_XDP, SOCK_RAW, 0)) < 0 )
+        {
+            perror("socket(AF_XDP):sr_xsk_open");
+            ret = -1;
+            break;
+        }
+        /* -- XDP sockets take no device ioctls, ask a plain one -- */
+        if ( (fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 )
+        {
+            perror("socket(..):sr_xsk_open");
+            ret = -1;
+            break;
+        }
+        ret = sr_ifmap_device(fd, dev, &(l->ifindex), mac[x->n - 1],
+                              &(ip[x->n - 1]));
+        close(fd);
+        if ( ret < 0 )
+        { break; }
+    }
+    if ( ret < 0 || x->n == 0 )
+    { goto fail; }
+
+    frames = x->n * SR_XSK_LINK_FRAMES;
+    x->umem_len = (size_t)frames * SR_XSK_FRAME_SZ;
+    x->umem = (uint8_t*)mmap(0, x->umem_len, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if ( x->umem == MAP_FAILED )
+    {
+        x->umem = 0;
+        perror("mmap(umem):sr_xsk_open");
+        goto fail;
+    }
+    x->free = (uint64_t*)malloc(frames * sizeof(uint64_t));
+    assert(x->free);
+    for ( i = frames; i > 0; i-- )
+    { x->free[x->nfree++] = (uint64_t)(i - 1) * SR_XSK_FRAME_SZ; }
+
+    for ( i = 0; i < x->n; i++ )
+    {
+        if ( sr_xsk_link_open(x, i) < 0 )
+        { goto fail; }
+        sr_xsk_refill(x, &(x->link[i]));
+        if ( sr_xsk_attach(&(x->link[i])) < 0 )
+        { goto fail; }
+
+        sr_add_interface(sr, x->link[i].name);
+        sr_set_ether_addr(sr, mac[i]);
+        sr_set_ether_ip(sr, ip[i]);
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+    return x;
+
+fail:
+    fprintf(stderr, "Error: could not set up interface map %s\n", map);
+    sr_xsk_close(x);
+    return 0;
+} /* -- sr_xsk_open -- */
+
+void sr_xsk_close(struct sr_xsk* x)
+{
+    unsigned int i;
+
+    if ( x == 0 )
+    { return; }
+
+    /* -- sharing sockets go before the one that registered the UMEM -- */
+    for ( i = x->n; i > 0; i-- )
+    { sr_xsk_link_close(&(x->link[i - 1])); }
+    if ( x->umem )
+    { munmap(x->umem, x->umem_len); }
+    free(x->free);
+    pthread_mutex_destroy(&(x->lock));
+    free(x);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_send(..)
+ * Scope:  Global
+ *
+ * Queue a frame on iface's transmit ring.  The frame the loop is handing
+ * to the router goes as it is, once; anything else is copied into a free
+ * UMEM frame.  Returns -1 and counts a drop if no frame or ring slot is
+ * to be had.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_xsk_send(struct sr_xsk* x, uint8_t* buf, unsigned int len,
+                const char* iface)
+{
+    struct sr_xsk_link* l = 0;
+    struct xdp_desc* desc;
+    uint64_t addr = SR_XSK_NONE;
+    uint32_t prod;
+    unsigned int i;
+    int zc = 0;
+
+    for ( i = 0; i < x->n; i++ )
+    {
+        if ( strncmp(x->link[i].name, iface, sr_IFACE_NAMELEN) == 0 )
+        {
+            l = &(x->link[i]);
+            break;
+        }
+    }
+    if ( l == 0 )
+    {
+        fprintf(stderr, "** Error, interface %s, does not exist\n", iface);
+        return -1;
+    }
+
+    pthread_mutex_lock(&(x->lock));
+
+    if ( buf >= x->umem && buf < x->umem + x->umem_len &&
+         SR_XSK_CHUNK((uint64_t)(buf - x->umem)) == x->rx_cur && !x->rx_taken &&
+         (uint64_t)(buf - x->umem) + len <= x->rx_cur + SR_XSK_FRAME_SZ )
+    {
+        addr = buf - x->umem;
+        x->rx_taken = 1;
+        zc = 1;
+    }
+    else if ( len <= SR_XSK_FRAME_SZ )
+    {
+        if ( x->nfree == 0 )
+        { sr_xsk_reap(x); }
+        if ( x->nfree > 0 )
+        {
+            addr = x->free[--x->nfree];
+            memcpy(x->umem + addr, buf, len);
+        }
+    }
+
+    if ( addr != SR_XSK_NONE && sr_xsk_ring_space(&(l->tx)) == 0 )
+    {
+        sr_xsk_kick(l);
+        sr_xsk_reap(x);
+    }
+    if ( addr == SR_XSK_NONE || sr_xsk_ring_space(&(l->tx)) == 0 )
+    {
+        if ( zc )
+        { x->rx_taken = 0; }
+        else if ( addr != SR_XSK_NONE )
+        { x->free[x->nfree++] = addr; }
+        l->tx_drops++;
+        pthread_mutex_unlock(&(x->lock));
+        return -1;
+    }
+
+    prod = *(l->tx.producer);
+    desc = &(((struct xdp_desc*)l->tx.desc)[prod & l->tx.mask]);
+    desc->addr = addr;
+    desc->len = len;
+    desc->options = 0;
+    __atomic_store_n(l->tx.producer, prod + 1, __ATOMIC_RELEASE);
+    l->tx_inflight++;
+    l->tx_packets++;
+    if ( zc )
+    { l->tx_zerocopy++; }
+    if ( ++l->tx_pending == SR_XSK_BATCH )
+    { sr_xsk_kick(l); }
+
+    pthread_mutex_unlock(&(x->lock));
+    return 0;
+} /* -- sr_xsk_send -- */
+
+/* kick every link with frames queued and collect completions; called
+   from sr_flush_packets(..) */
+int sr_xsk_flush(struct sr_xsk* x)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&(x->lock));
+    for ( i = 0; i < x->n; i++ )
+    {
+        if ( x->link[i].tx_pending > 0 )
+        { sr_xsk_kick(&(x->link[i])); }
+    }
+    sr_xsk_reap(x);
+    pthread_mutex_unlock(&(x->lock));
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_rx(..)
+ * Scope:  Local
+ *
+ * Hand up to a batch of received frames to the router, return the ones
+ * it did not send on to the free stack and top up the fill ring.  Only
+ * the loop thread consumes rx rings.  Returns the number handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_xsk_rx(struct sr_instance* sr, struct sr_xsk* x,
+                              struct sr_xsk_link* l)
+{
+    struct xdp_desc* desc = (struct xdp_desc*)l->rx.desc;
+    uint64_t done[SR_XSK_BATCH];
+    uint32_t n, cons, k, ndone = 0;
+
+    if ( (n = sr_xsk_ring_ready(&(l->rx))) > SR_XSK_BATCH )
+    { n = SR_XSK_BATCH; }
+    cons = *(l->rx.consumer);
+
+    for ( k = 0; k < n; k++ )
+    {
+        struct xdp_desc* d = &(desc[(cons + k) & l->rx.mask]);
+
+        x->rx_cur = SR_XSK_CHUNK(d->addr);
+        x->rx_taken = 0;
+        sr_deliver_packet(sr, x->umem + d->addr, d->len, l->name);
+        if ( !x->rx_taken )
+        { done[ndone++] = x->rx_cur; }
+    }
+    x->rx_cur = SR_XSK_NONE;
+    __atomic_store_n(l->rx.consumer, cons + n, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&(x->lock));
+    for ( k = 0; k < ndone; k++ )
+    { x->free[x->nfree++] = done[k]; }
+    sr_xsk_refill(x, l);
+    pthread_mutex_unlock(&(x->lock));
+
+    l->rx_packets += n;
+    return n;
+} /* -- sr_xsk_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xsk_loop(..)
+ * Scope:  Global
+ *
+ * Main loop for this backend, like sr_afpacket_loop(..).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_xsk_loop(struct sr_instance* sr)
+{
+    struct sr_xsk* x = sr->xsk;
+    struct pollfd pfd[SR_XSK_MAX_LINKS];
+    uint64_t now, next_tick;
+    unsigned int i, got, ms = sr_arpcache_tick_ms(&(sr->cache));
+    int timeout;
+
+    /* REQUIRES */
+    assert(x);
+
+    for ( i = 0; i < x->n; i++ )
+    {
+        pfd[i].fd = x->link[i].fd;
+        pfd[i].events = POLLIN;
+    }
+    next_tick = sr_arpcache_now() + ms;
+
+    while ( 1 )
+    {
+        timeout = -1;
+        if ( sr->event_loop )
+        {
+            now = sr_arpcache_now();
+            timeout = next_tick > now ? (int)(next_tick - now) : 0;
+        }
+
+        if ( poll(pfd, x->n, timeout) < 0 && errno != EINTR )
+        {
+            perror("poll(..):sr_xsk_loop");
+            return -1;
+        }
+
+        /* -- keep going while there is work, then wait again -- */
+        do
+        {
+            got = 0;
+            for ( i = 0; i < x->n; i++ )
+            { got += sr_xsk_rx(sr, x, &(x->link[i])); }
+            sr_flush_packets(sr);
+        } while ( got > 0 );
+
+        if ( sr->event_loop && sr_arpcache_now() >= next_tick )
+        {
+            sr_arpcache_tick(sr);
+            next_tick = sr_arpcache_now() + ms;
+        }
+    }
+
+    return 0;
+} /* -- sr_xsk_loop -- */
+
+#else
+
+struct sr_xsk* sr_xsk_open(struct sr_instance* sr, const char* map)
+{
+    fprintf(stderr, "Error: the AF_XDP backend needs Linux\n");
+    return 0;
+}
+
+void sr_xsk_close(struct sr_xsk* x)
+{
+}
+
+int sr_xsk_send(struct sr_xsk* x, uint8_t* buf, unsigned int len,
+                const char* iface)
+{
+    return -1;
+}
+
+int sr_xsk_flush(struct sr_xsk* x)
+{
+    return 0;
+}
+
+int sr_xsk_loop(struct sr_instance* sr)
+{
+    return -1;
+}
+
+#endif /* _LINUX_ */
@@ -0,0 +1,96 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_xsk.h
+ *
+ * Description:
+ *
+ * AF_XDP data-plane backend.  Every router interface gets an XDP socket on
+ * queue 0 of its host device, and all of them share one UMEM, so a frame
+ * received on one interface can be rewritten where it lies and put on
+ * another interface's transmit ring without being copied.  Frames the
+ * router builds itself (ICMP errors, ARP, queued packets) are copied into
+ * a free UMEM frame.
+ *
+ * A small XDP program redirecting everything to the socket is built and
+ * attached with the bpf(2) syscall directly, in generic (SKB) mode, so no
+ * libbpf is needed and veth pairs on a stock kernel will do.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_XSK_H
+#define sr_XSK_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_if.h"
+
+#define SR_XSK_MAX_LINKS    16
+#define SR_XSK_FRAME_SZ     4096        /* UMEM chunk, a power of two */
+#define SR_XSK_RING_SZ      1024        /* entries in each ring */
+#define SR_XSK_LINK_FRAMES  (2 * SR_XSK_RING_SZ)    /* UMEM frames per link */
+#define SR_XSK_BATCH        64          /* frames taken from a ring at once */
+
+struct sr_instance;
+
+/* producer/consumer view of one of the four rings the kernel maps */
+struct sr_xsk_ring
+{
+    uint32_t* producer;
+    uint32_t* consumer;
+    void* desc;
+    uint32_t mask;
+    void* map;
+    size_t map_len;
+};
+
+struct sr_xsk_link
+{
+    char name[sr_IFACE_NAMELEN];    /* router interface */
+    char dev[sr_IFACE_NAMELEN];     /* host device */
+    int ifindex;
+    int fd;                         /* XDP socket */
+    int map_fd;                     /* XSKMAP holding fd */
+    int prog_fd;
+    int bpf_link_fd;                /* keeps the program attached */
+    struct sr_xsk_ring rx;
+    struct sr_xsk_ring tx;
+    struct sr_xsk_ring fill;
+    struct sr_xsk_ring comp;
+    unsigned int tx_pending;        /* queued since the last kick */
+    unsigned int tx_inflight;       /* queued and not yet completed */
+    unsigned long rx_packets;
+    unsigned long tx_packets;
+    unsigned long tx_zerocopy;      /* sent from the frame they arrived in */
+    unsigned long tx_drops;
+};
+
+struct sr_xsk
+{
+    unsigned int n;
+    struct sr_xsk_link link[SR_XSK_MAX_LINKS];
+    uint8_t* umem;
+    size_t umem_len;
+    uint64_t* free;                 /* stack of free frame addresses */
+    unsigned int nfree;
+    uint64_t rx_cur;                /* frame being handled by the loop */
+    int rx_taken;                   /* and it has been put on a tx ring */
+    pthread_mutex_t lock;           /* free stack, tx, fill and comp rings */
+};
+
+/* map is "name[=dev][@ip],..." as for sr_afpacket_open(..) */
+struct sr_xsk* sr_xsk_open(struct sr_instance* , const char* map);
+void sr_xsk_close(struct sr_xsk* );
+int sr_xsk_send(struct sr_xsk* , uint8_t* buf, unsigned int len,
+                const char* iface);
+int sr_xsk_flush(struct sr_xsk* );
+int sr_xsk_loop(struct sr_instance* );
+
+#endif  /* --  sr_XSK_H -- */